@@ -4,6 +4,8 @@
 #include <stdio.h>
 #include "devices/ide.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
 
 /* A block device. */
 struct block
@@ -19,6 +21,10 @@ struct block
 
     unsigned long long read_cnt;        /* Number of sectors read. */
     unsigned long long write_cnt;       /* Number of sectors written. */
+    unsigned long long read_req_cnt;    /* Number of read requests. */
+    unsigned long long write_req_cnt;   /* Number of write requests. */
+    unsigned long long cache_hit_cnt;   /* Sectors found in a cache. */
+    unsigned long long cache_miss_cnt;  /* Sectors not found in a cache. */
   };
 
 /* List of all block devices. */
@@ -28,6 +34,7 @@ static struct list all_blocks = LIST_INITIALIZER (all_blocks);
 static struct block *block_by_role[BLOCK_ROLE_CNT];
 
 static struct block *list_elem_to_block (struct list_elem *);
+static void count_request (struct block *, size_t cnt, bool write);
 
 /* Returns a human-readable name for the given block device
    TYPE. */
@@ -113,6 +120,101 @@ check_sector (struct block *block, block_sector_t sector)
     }
 }
 
+/* Transfers CNT sectors starting at SECTOR between BLOCK and
+   BUFFER, in the direction given by WRITE, with the driver's
+   synchronous operations.  Doesn't update statistics. */
+static void
+transfer_sync (struct block *block, block_sector_t sector, size_t cnt,
+               void *buffer, bool write)
+{
+  const struct block_operations *ops = block->ops;
+  uint8_t *p = buffer;
+  size_t i;
+
+  if (write && ops->write_multiple != NULL)
+    ops->write_multiple (block->aux, sector, cnt, buffer);
+  else if (!write && ops->read_multiple != NULL)
+    ops->read_multiple (block->aux, sector, cnt, buffer);
+  else
+    for (i = 0; i < cnt; i++, p += BLOCK_SECTOR_SIZE)
+      {
+        if (write)
+          ops->write (block->aux, sector + i, p);
+        else
+          ops->read (block->aux, sector + i, p);
+      }
+}
+
+/* Submits a request to transfer CNT sectors starting at SECTOR
+   between BLOCK and BUFFER and waits for it to finish.
+
+   Requests may be carried out in interrupt context, where only
+   kernel memory is reliably mapped.  So if BUFFER is elsewhere,
+   such as in a user process's address space, the data goes
+   through a kernel bounce buffer instead, a page at a time. */
+static void
+transfer_wait (struct block *block, block_sector_t sector, size_t cnt,
+               void *buffer, bool write)
+{
+  struct block_request r;
+  uint8_t sector_buf[BLOCK_SECTOR_SIZE];
+  uint8_t *bounce, *p;
+  size_t page_cnt;
+
+  if (is_kernel_vaddr (buffer)) 
+    {
+      block_request_init (&r, sector, cnt, buffer, write);
+      block_submit (block, &r);
+      block_wait (&r);
+      return;
+    }
+
+  bounce = palloc_get_page (0);
+  page_cnt = bounce != NULL ? PGSIZE / BLOCK_SECTOR_SIZE : 1;
+  if (bounce == NULL)
+    bounce = sector_buf;
+  for (p = buffer; cnt > 0; )
+    {
+      size_t n = cnt < page_cnt ? cnt : page_cnt;
+      size_t size = n * BLOCK_SECTOR_SIZE;
+
+      if (write)
+        memcpy (bounce, p, size);
+      block_request_init (&r, sector, n, bounce, write);
+      block_submit (block, &r);
+      block_wait (&r);
+      if (!write)
+        memcpy (p, bounce, size);
+      sector += n;
+      cnt -= n;
+      p += size;
+    }
+  if (bounce != sector_buf)
+    palloc_free_page (bounce);
+}
+
+/* Transfers CNT sectors starting at SECTOR between BLOCK and
+   BUFFER, in the direction given by WRITE, and returns when the
+   transfer is done. */
+static void
+transfer (struct block *block, block_sector_t sector, size_t cnt,
+          void *buffer, bool write)
+{
+  if (cnt == 0)
+    return;
+  check_sector (block, sector);
+  check_sector (block, sector + cnt - 1);
+  ASSERT (!write || block->type != BLOCK_FOREIGN);
+
+  if (block->ops->submit != NULL)
+    transfer_wait (block, sector, cnt, buffer, write);
+  else
+    {
+      transfer_sync (block, sector, cnt, buffer, write);
+      count_request (block, cnt, write);
+    }
+}
+
 /* Reads sector SECTOR from BLOCK into BUFFER, which must
    have room for BLOCK_SECTOR_SIZE bytes.
    Internally synchronizes accesses to block devices, so external
@@ -120,9 +222,7 @@ check_sector (struct block *block, block_sector_t sector)
 void
 block_read (struct block *block, block_sector_t sector, void *buffer)
 {
-  check_sector (block, sector);
-  block->ops->read (block->aux, sector, buffer);
-  block->read_cnt++;
+  transfer (block, sector, 1, buffer, false);
 }
 
 /* Write sector SECTOR to BLOCK from BUFFER, which must contain
@@ -133,10 +233,186 @@ block_read (struct block *block, block_sector_t sector, void *buffer)
 void
 block_write (struct block *block, block_sector_t sector, const void *buffer)
 {
-  check_sector (block, sector);
-  ASSERT (block->type != BLOCK_FOREIGN);
-  block->ops->write (block->aux, sector, buffer);
-  block->write_cnt++;
+  transfer (block, sector, 1, (void *) buffer, true);
+}
+
+/* Reads the CNT sectors starting at SECTOR from BLOCK into
+   BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE bytes.
+   Drivers that support it transfer the whole run in one
+   request, so the per-request overhead is paid once rather than
+   once per sector.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_read_multiple (struct block *block, block_sector_t sector, size_t cnt,
+                     void *buffer)
+{
+  transfer (block, sector, cnt, buffer, false);
+}
+
+/* Writes the CNT sectors starting at SECTOR to BLOCK from
+   BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes, as
+   block_read_multiple().  Returns after the block device has
+   acknowledged receiving the data.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_write_multiple (struct block *block, block_sector_t sector,
+                      size_t cnt, const void *buffer)
+{
+  transfer (block, sector, cnt, (void *) buffer, true);
+}
+
+/* Initializes R as a request to transfer CNT sectors starting at
+   SECTOR to BUFFER, or from BUFFER if WRITE is true.  BUFFER must
+   be in kernel memory.  R completes by upping its semaphore;
+   set R->done afterward to be called back instead. */
+void
+block_request_init (struct block_request *r, block_sector_t sector,
+                    size_t cnt, void *buffer, bool write)
+{
+  r->sector = sector;
+  r->cnt = cnt;
+  r->buffer = buffer;
+  r->write = write;
+  r->done = NULL;
+  r->aux = NULL;
+  sema_init (&r->done_sema, 0);
+}
+
+/* Starts request R on BLOCK and returns without waiting for it
+   to finish.  R must stay allocated until it completes.  A
+   driver may change R's sector member, e.g. a partition adds
+   its offset on the underlying disk. */
+void
+block_submit (struct block *block, struct block_request *r)
+{
+  ASSERT (r->cnt > 0);
+  ASSERT (is_kernel_vaddr (r->buffer));
+  check_sector (block, r->sector);
+  check_sector (block, r->sector + r->cnt - 1);
+  ASSERT (!r->write || block->type != BLOCK_FOREIGN);
+
+  count_request (block, r->cnt, r->write);
+  if (block->ops->submit != NULL)
+    block->ops->submit (block->aux, r);
+  else 
+    {
+      transfer_sync (block, r->sector, r->cnt, r->buffer, r->write);
+      block_complete (r);
+    }
+}
+
+/* Waits for request R, which must not have a completion
+   callback, to finish. */
+void
+block_wait (struct block_request *r)
+{
+  ASSERT (r->done == NULL);
+  sema_down (&r->done_sema);
+}
+
+/* Called by a driver when request R has finished, possibly in
+   interrupt context. */
+void
+block_complete (struct block_request *r)
+{
+  if (r->done != NULL)
+    r->done (r);
+  else
+    sema_up (&r->done_sema);
+}
+
+/* Adds a request for CNT sectors to BLOCK's statistics. */
+static void
+count_request (struct block *block, size_t cnt, bool write)
+{
+  if (write) 
+    {
+      block->write_cnt += cnt;
+      block->write_req_cnt++;
+    }
+  else 
+    {
+      block->read_cnt += cnt;
+      block->read_req_cnt++;
+    }
+}
+
+/* Initializes Q as an empty queue. */
+void
+block_queue_init (struct block_queue *q)
+{
+  list_init (&q->requests);
+  q->head = 0;
+}
+
+/* Returns true if Q has no requests. */
+bool
+block_queue_empty (struct block_queue *q)
+{
+  return list_empty (&q->requests);
+}
+
+/* Returns R's position in the C-LOOK order of a queue whose head
+   is at HEAD: the distance from HEAD up to R's first sector,
+   wrapping past the top of the disk. */
+static block_sector_t
+queue_rank (const struct block_request *r, block_sector_t head)
+{
+  return r->sector - head;
+}
+
+/* Adds R to Q in C-LOOK order, after any requests for the same
+   position. */
+void
+block_queue_add (struct block_queue *q, struct block_request *r)
+{
+  block_sector_t rank = queue_rank (r, q->head);
+  struct list_elem *e;
+
+  for (e = list_begin (&q->requests); e != list_end (&q->requests);
+       e = list_next (e))
+    if (queue_rank (list_entry (e, struct block_request, elem), q->head)
+        > rank)
+      break;
+  list_insert (e, &r->elem);
+}
+
+/* Removes the next request from Q, which must not be empty, and
+   appends it to BATCH, followed by any further requests in the
+   same direction that continue where the previous one left off,
+   as long as the total stays within MAX_CNT sectors.  (The first
+   request is taken whatever its size.)  Moves Q's head past the
+   batch and returns the total number of sectors in it. */
+size_t
+block_queue_next (struct block_queue *q, struct list *batch, size_t max_cnt)
+{
+  struct block_request *r;
+  block_sector_t end;
+  bool write;
+  size_t cnt;
+
+  ASSERT (!block_queue_empty (q));
+
+  r = list_entry (list_pop_front (&q->requests), struct block_request, elem);
+  list_push_back (batch, &r->elem);
+  write = r->write;
+  cnt = r->cnt;
+  end = r->sector + r->cnt;
+
+  while (!list_empty (&q->requests)) 
+    {
+      r = list_entry (list_front (&q->requests), struct block_request, elem);
+      if (r->write != write || r->sector != end || cnt + r->cnt > max_cnt)
+        break;
+      list_push_back (batch, list_pop_front (&q->requests));
+      cnt += r->cnt;
+      end += r->cnt;
+    }
+
+  q->head = end;
+  return cnt;
 }
 
 /* Returns the number of sectors in BLOCK. */
@@ -171,13 +447,31 @@ block_print_stats (void)
       struct block *block = block_by_role[i];
       if (block != NULL)
         {
-          printf ("%s (%s): %llu reads, %llu writes\n",
+          printf ("%s (%s): %llu reads, %llu writes "
+                  "(%llu read requests, %llu write requests)\n",
                   block->name, block_type_name (block->type),
-                  block->read_cnt, block->write_cnt);
+                  block->read_cnt, block->write_cnt,
+                  block->read_req_cnt, block->write_req_cnt);
+          if (block->cache_hit_cnt + block->cache_miss_cnt > 0)
+            printf ("%s (%s): %llu cache hits, %llu cache misses\n",
+                    block->name, block_type_name (block->type),
+                    block->cache_hit_cnt, block->cache_miss_cnt);
         }
     }
 }
 
+/* Adds CNT sector lookups in a cache kept in front of BLOCK,
+   such as the file system's buffer cache, to BLOCK's statistics,
+   as hits if HIT is true and misses otherwise. */
+void
+block_count_cache (struct block *block, size_t cnt, bool hit)
+{
+  if (hit)
+    block->cache_hit_cnt += cnt;
+  else
+    block->cache_miss_cnt += cnt;
+}
+
 /* Registers a new block device with the given NAME.  If
    EXTRA_INFO is non-null, it is printed as part of a user
    message.  The block device's SIZE in sectors and its TYPE must
@@ -200,6 +494,10 @@ block_register (const char *name, enum block_type type,
   block->aux = aux;
   block->read_cnt = 0;
   block->write_cnt = 0;
+  block->read_req_cnt = 0;
+  block->write_req_cnt = 0;
+  block->cache_hit_cnt = 0;
+  block->cache_miss_cnt = 0;
 
   printf ("%s: %'"PRDSNu" sectors (", block->name, block->size);
   print_human_readable_size ((uint64_t) block->size * BLOCK_SECTOR_SIZE);
@@ -3,6 +3,8 @@
 
 #include <stddef.h>
 #include <inttypes.h>
+#include <list.h>
+#include "threads/synch.h"
 
 /* Size of a block device sector in bytes.
    All IDE disks use this sector size, as do most USB and SCSI
@@ -53,11 +55,40 @@ struct block *block_next (struct block *);
 block_sector_t block_size (struct block *);
 void block_read (struct block *, block_sector_t, void *);
 void block_write (struct block *, block_sector_t, const void *);
+void block_read_multiple (struct block *, block_sector_t, size_t cnt, void *);
+void block_write_multiple (struct block *, block_sector_t, size_t cnt,
+                           const void *);
 const char *block_name (struct block *);
 enum block_type block_type (struct block *);
 
+/* An asynchronous block request.
+
+   block_submit() starts the request and returns at once.  When
+   the transfer finishes, the driver calls block_complete(), which
+   calls DONE if it is nonnull and otherwise ups DONE_SEMA, so the
+   submitter can go on with other work and collect the result
+   later with block_wait().  DONE runs in interrupt context. */
+struct block_request
+  {
+    struct list_elem elem;              /* Element in a driver queue. */
+    block_sector_t sector;              /* First sector. */
+    size_t cnt;                         /* Number of sectors. */
+    void *buffer;                       /* Kernel buffer, CNT sectors. */
+    bool write;                         /* Write if true, else read. */
+
+    void (*done) (struct block_request *); /* Completion callback. */
+    void *aux;                          /* For use by DONE. */
+    struct semaphore done_sema;         /* Up'd on completion if no DONE. */
+  };
+
+void block_request_init (struct block_request *, block_sector_t, size_t cnt,
+                         void *buffer, bool write);
+void block_submit (struct block *, struct block_request *);
+void block_wait (struct block_request *);
+
 /* Statistics. */
 void block_print_stats (void);
+void block_count_cache (struct block *, size_t cnt, bool hit);
 
 /* Lower-level interface to block device drivers. */
 
@@ -65,8 +96,42 @@ struct block_operations
   {
     void (*read) (void *aux, block_sector_t, void *buffer);
     void (*write) (void *aux, block_sector_t, const void *buffer);
+
+    /* Transfer CNT consecutive sectors in one request.  Optional:
+       if null, the block layer calls read or write once per
+       sector instead. */
+    void (*read_multiple) (void *aux, block_sector_t, size_t cnt,
+                           void *buffer);
+    void (*write_multiple) (void *aux, block_sector_t, size_t cnt,
+                            const void *buffer);
+
+    /* Starts an asynchronous request.  Optional: if null,
+       block_submit() does the transfer synchronously with the
+       operations above.  A driver that provides it may leave the
+       others null, and then every transfer goes through here. */
+    void (*submit) (void *aux, struct block_request *);
+  };
+
+void block_complete (struct block_request *);
+
+/* A queue of pending requests for one disk, kept in C-LOOK
+   (circular elevator) order: ascending by sector from the
+   current head position, then wrapping around to the lowest
+   sector.  Drivers that accept several requests at once can use
+   it to serve them in seek order and to merge requests for
+   adjacent sectors into one transfer. */
+struct block_queue
+  {
+    struct list requests;               /* Pending requests. */
+    block_sector_t head;                /* Sector after last dispatched. */
   };
 
+void block_queue_init (struct block_queue *);
+bool block_queue_empty (struct block_queue *);
+void block_queue_add (struct block_queue *, struct block_request *);
+size_t block_queue_next (struct block_queue *, struct list *batch,
+                         size_t max_cnt);
+
 struct block *block_register (const char *name, enum block_type,
                               const char *extra_info, block_sector_t size,
                               const struct block_operations *, void *aux);
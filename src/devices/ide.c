@@ -8,10 +8,27 @@
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
-   controller.  It attempts to comply to [ATA-3]. */
+   controller.  It attempts to comply to [ATA-3].
+
+   Data moves between memory and the disk either by programmed
+   I/O (PIO), with the CPU copying every word through the data
+   register, or, if the "-dma" option is given and a PCI
+   bus-master IDE controller is found, by bus-master DMA, with
+   the controller copying the data itself while the CPU does
+   other work.  See the "Bus master DMA" section below.
+
+   Either way, requests are asynchronous: ide_submit() queues a
+   request and, if the channel is idle, starts it, and the
+   interrupt handler moves the data, completes finished requests
+   and starts the next one.  See "Request queue" below. */
+
+/* -dma: Use bus-master DMA if the controller supports it? */
+bool ide_use_dma;
 
 /* ATA command block port addresses. */
 #define reg_data(CHANNEL) ((CHANNEL)->reg_base + 0)     /* Data. */
@@ -33,7 +50,9 @@
 /* Alternate Status Register bits. */
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
+#define STA_DF 0x20             /* Device Fault. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -49,6 +68,38 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_MULTIPLE 0xc4          /* READ MULTIPLE. */
+#define CMD_WRITE_MULTIPLE 0xc5         /* WRITE MULTIPLE. */
+#define CMD_SET_MULTIPLE_MODE 0xc6      /* SET MULTIPLE MODE. */
+#define CMD_READ_DMA 0xc8               /* READ DMA. */
+#define CMD_WRITE_DMA 0xca              /* WRITE DMA. */
+
+/* Bus master IDE register offsets from a channel's bus master
+   base.  See the
+   "Programming Interface for Bus Master IDE Controller" (SFF-8038i). */
+#define BM_COMMAND 0            /* Command. */
+#define BM_STATUS 2             /* Status. */
+#define BM_PRDT 4               /* PRD table physical address. */
+
+/* Bus master Command register bits. */
+#define BM_CMD_START 0x01       /* Start transfer. */
+#define BM_CMD_READ 0x08        /* Transfer from disk to memory. */
+
+/* Bus master Status register bits. */
+#define BM_STA_ACTIVE 0x01      /* Transfer in progress. */
+#define BM_STA_ERROR 0x02       /* Transfer failed (write 1 to clear). */
+#define BM_STA_INTR 0x04        /* Interrupt raised (write 1 to clear). */
+
+/* A physical region descriptor: one physically contiguous piece
+   of a DMA transfer.  A region may not cross a 64 kB boundary. */
+struct prd
+  {
+    uint32_t addr;              /* Physical address. */
+    uint16_t size;              /* Size in bytes; 0 means 64 kB. */
+    uint16_t flags;             /* PRD_EOT on the last region. */
+  };
+
+#define PRD_EOT 0x8000          /* End of table. */
 
 /* An ATA device. */
 struct ata_disk
@@ -57,8 +108,18 @@ struct ata_disk
     struct channel *channel;    /* Channel that disk is attached to. */
     int dev_no;                 /* Device 0 or 1 for master or slave. */
     bool is_ata;                /* Is device an ATA disk? */
+    int multiple;               /* Sectors per READ/WRITE MULTIPLE
+                                   block, or 0 if not supported. */
+    struct block_queue queue;   /* Requests waiting for the channel. */
   };
 
+/* Most sectors one ATA command can transfer, with the sector
+   count register set to 0. */
+#define MAX_COMMAND_SECTORS 256
+
+/* Most sectors of adjacent requests merged into one batch. */
+#define MAX_BATCH_SECTORS 256
+
 /* An ATA channel (aka controller).
    Each channel can control up to two disks. */
 struct channel
@@ -67,11 +128,30 @@ struct channel
     uint16_t reg_base;          /* Base I/O port. */
     uint8_t irq;                /* Interrupt in use. */
 
-    struct lock lock;           /* Must acquire to access the controller. */
     bool expecting_interrupt;   /* True if an interrupt is expected, false if
                                    any interrupt would be spurious. */
     struct semaphore completion_wait;   /* Up'd by interrupt handler. */
 
+    /* Bus master DMA, if in use on this channel. */
+    uint16_t bm_base;           /* Bus master I/O base, 0 if PIO only. */
+    struct prd *prdt;           /* PRD table, one page. */
+
+    /* Batch of requests in progress.  Interrupts must be off to
+       access these members. */
+    struct ata_disk *busy;      /* Disk serving BATCH, null if idle. */
+    struct list batch;          /* Merged requests, in sector order. */
+    block_sector_t batch_sector; /* First sector of BATCH. */
+    size_t batch_cnt;           /* Total sectors in BATCH. */
+    bool write;                 /* Direction of BATCH. */
+    bool dma;                   /* Transferring BATCH by DMA? */
+    block_sector_t sector;      /* Next sector to start a command at. */
+    size_t left;                /* Sectors not yet covered by a command. */
+    size_t cmd_left;            /* Sectors of current command still to
+                                   move through the data register. */
+    struct list_elem *cur;      /* Request holding the next sector. */
+    size_t cur_ofs;             /* Sectors of CUR already transferred. */
+    int next_dev;               /* Device to serve first when idle. */
+
     struct ata_disk devices[2];     /* The devices on this channel. */
   };
 
@@ -85,7 +165,8 @@ static void reset_channel (struct channel *);
 static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
 
-static void select_sector (struct ata_disk *, block_sector_t);
+static void set_multiple_mode (struct ata_disk *, int max);
+static void select_sector (struct ata_disk *, block_sector_t, size_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
@@ -95,14 +176,29 @@ static bool wait_while_busy (const struct ata_disk *);
 static void select_device (const struct ata_disk *);
 static void select_device_wait (const struct ata_disk *);
 
+static uint16_t find_bus_master (void);
+static void init_dma (struct channel *, uint16_t bm_base);
+static void dma_start (struct channel *, size_t cnt);
+static bool dma_finish (struct channel *);
+
+static void start_batch (struct channel *);
+
 static void interrupt_handler (struct intr_frame *);
 
 /* Initialize the disk subsystem and detect disks. */
 void
 ide_init (void) 
 {
+  uint16_t bm_base = 0;
   size_t chan_no;
 
+  if (ide_use_dma) 
+    {
+      bm_base = find_bus_master ();
+      if (bm_base == 0)
+        printf ("ide: no bus master IDE controller, using PIO\n");
+    }
+
   for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
     {
       struct channel *c = &channels[chan_no];
@@ -123,9 +219,13 @@ ide_init (void)
         default:
           NOT_REACHED ();
         }
-      lock_init (&c->lock);
       c->expecting_interrupt = false;
       sema_init (&c->completion_wait, 0);
+      c->busy = NULL;
+      c->next_dev = 0;
+      c->bm_base = 0;
+      if (bm_base != 0)
+        init_dma (c, bm_base + chan_no * 8);
  
       /* Initialize devices. */
       for (dev_no = 0; dev_no < 2; dev_no++)
@@ -136,6 +236,8 @@ ide_init (void)
           d->channel = c;
           d->dev_no = dev_no;
           d->is_ata = false;
+          d->multiple = 0;
+          block_queue_init (&d->queue);
         }
 
       /* Register interrupt handler. */
@@ -289,6 +391,10 @@ identify_ata_device (struct ata_disk *d)
   snprintf (extra_info, sizeof extra_info,
             "model \"%s\", serial \"%s\"", model, serial);
 
+  /* Enable READ/WRITE MULTIPLE with the largest block size the
+     disk supports, given in the low byte of word 47. */
+  set_multiple_mode (d, *(uint16_t *) &id[47 * 2] & 0xff);
+
   /* Disable access to IDE disks over 1 GB, which are likely
      physical IDE disks rather than virtual ones.  If we don't
      allow access to those, we're less likely to scribble on
@@ -337,63 +443,296 @@ descramble_ata_string (char *string, int size)
   return string;
 }
 
-/* Reads sector SEC_NO from disk D into BUFFER, which must have
-   room for BLOCK_SECTOR_SIZE bytes.
-   Internally synchronizes accesses to disks, so external
-   per-disk locking is unneeded. */
+/* Tells disk D to transfer up to MAX sectors per interrupt in
+   READ MULTIPLE and WRITE MULTIPLE commands, and records the
+   result in D's multiple member. */
 static void
-ide_read (void *d_, block_sector_t sec_no, void *buffer)
+set_multiple_mode (struct ata_disk *d, int max) 
 {
-  struct ata_disk *d = d_;
   struct channel *c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
+
+  d->multiple = 0;
+  if (max <= 1)
+    return;
+
+  select_device_wait (d);
+  outb (reg_nsect (c), max);
+  issue_pio_command (c, CMD_SET_MULTIPLE_MODE);
   sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
-  lock_release (&c->lock);
+  wait_while_busy (d);
+  if ((inb (reg_status (c)) & STA_ERR) == 0)
+    d->multiple = max;
+}
+
+/* Request queue.
+
+   Each disk keeps its pending requests in a block_queue, in
+   C-LOOK order.  When its channel goes idle, start_batch() takes
+   the request at the front of the next disk's queue, along with
+   any requests right behind it for the following sectors in the
+   same direction, and serves the whole batch with as few ATA
+   commands as possible.  The two disks on a channel take turns.
+
+   Everything from there on happens in the interrupt handler: in
+   PIO mode, each interrupt moves the next block of sectors
+   through the data register; in DMA mode, one interrupt ends the
+   whole command.  When the batch is done, its requests are
+   completed and the next batch is started, so the submitting
+   threads never touch the controller. */
+
+/* Returns the address in the request buffers at which the
+   sector at C's cursor goes. */
+static uint8_t *
+cursor_ptr (struct channel *c) 
+{
+  struct block_request *r = list_entry (c->cur, struct block_request, elem);
+  return (uint8_t *) r->buffer + c->cur_ofs * BLOCK_SECTOR_SIZE;
+}
+
+/* Advances C's cursor over CNT sectors, which must not run past
+   the end of the current request. */
+static void
+cursor_advance (struct channel *c, size_t cnt) 
+{
+  struct block_request *r = list_entry (c->cur, struct block_request, elem);
+
+  c->cur_ofs += cnt;
+  ASSERT (c->cur_ofs <= r->cnt);
+  if (c->cur_ofs == r->cnt)
+    {
+      c->cur = list_next (c->cur);
+      c->cur_ofs = 0;
+    }
+}
+
+/* Returns the number of sectors, at most MAX, from C's cursor to
+   the end of the current request. */
+static size_t
+cursor_run (struct channel *c, size_t max) 
+{
+  struct block_request *r = list_entry (c->cur, struct block_request, elem);
+  size_t cnt = r->cnt - c->cur_ofs;
+  return cnt < max ? cnt : max;
+}
+
+/* Moves the next block of the current PIO command through C's
+   data register: up to one READ/WRITE MULTIPLE block, or one
+   sector without multiple mode. */
+static void
+pio_block (struct channel *c) 
+{
+  struct ata_disk *d = c->busy;
+  size_t n = d->multiple > 0 ? (size_t) d->multiple : 1;
+
+  if (n > c->cmd_left)
+    n = c->cmd_left;
+  c->cmd_left -= n;
+  for (; n > 0; n--) 
+    {
+      if (c->write)
+        output_sector (c, cursor_ptr (c));
+      else
+        input_sector (c, cursor_ptr (c));
+      cursor_advance (c, 1);
+    }
+}
+
+/* Points C's cursor back at the start of its batch. */
+static void
+rewind_batch (struct channel *c) 
+{
+  c->sector = c->batch_sector;
+  c->left = c->batch_cnt;
+  c->cur = list_begin (&c->batch);
+  c->cur_ofs = 0;
+}
+
+/* Issues the ATA command for the next part of C's batch.  For a
+   PIO write, also sends the first block of data. */
+static void
+start_command (struct channel *c) 
+{
+  struct ata_disk *d = c->busy;
+  size_t cnt = c->left < MAX_COMMAND_SECTORS ? c->left : MAX_COMMAND_SECTORS;
+  block_sector_t sector = c->sector;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (cnt > 0);
+
+  c->sector += cnt;
+  c->left -= cnt;
+  if (c->dma) 
+    {
+      dma_start (c, cnt);
+      return;
+    }
+
+  c->cmd_left = cnt;
+  select_sector (d, sector, cnt);
+  if (c->write) 
+    {
+      issue_pio_command (c, (d->multiple > 0
+                             ? CMD_WRITE_MULTIPLE : CMD_WRITE_SECTOR_RETRY));
+      if (!wait_while_busy (d))
+        PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sector);
+      pio_block (c);
+    }
+  else
+    issue_pio_command (c, (d->multiple > 0
+                           ? CMD_READ_MULTIPLE : CMD_READ_SECTOR_RETRY));
+}
+
+/* Returns true if every request in C's batch can be the target
+   of DMA.  Physical regions must be word-aligned. */
+static bool
+batch_dma_ok (struct channel *c) 
+{
+  struct list_elem *e;
+
+  if (c->bm_base == 0)
+    return false;
+  for (e = list_begin (&c->batch); e != list_end (&c->batch);
+       e = list_next (e))
+    {
+      struct block_request *r = list_entry (e, struct block_request, elem);
+      if (((uintptr_t) r->buffer & 1) != 0)
+        return false;
+    }
+  return true;
+}
+
+/* If channel C is idle, starts serving the next batch of queued
+   requests, if there are any. */
+static void
+start_batch (struct channel *c) 
+{
+  struct block_request *first;
+  struct ata_disk *d = NULL;
+  int i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  if (c->busy != NULL)
+    return;
+
+  for (i = 0; i < 2; i++) 
+    {
+      struct ata_disk *candidate = &c->devices[(c->next_dev + i) % 2];
+      if (!block_queue_empty (&candidate->queue)) 
+        {
+          d = candidate;
+          break;
+        }
+    }
+  if (d == NULL)
+    return;
+  c->next_dev = !d->dev_no;
+
+  list_init (&c->batch);
+  c->batch_cnt = block_queue_next (&d->queue, &c->batch, MAX_BATCH_SECTORS);
+  first = list_entry (list_front (&c->batch), struct block_request, elem);
+  c->batch_sector = first->sector;
+  c->write = first->write;
+  c->busy = d;
+  c->dma = batch_dma_ok (c);
+  rewind_batch (c);
+  start_command (c);
+}
+
+/* Completes every request in C's finished batch, marks C idle,
+   and starts the next batch. */
+static void
+finish_batch (struct channel *c) 
+{
+  while (!list_empty (&c->batch)) 
+    {
+      struct list_elem *e = list_pop_front (&c->batch);
+      block_complete (list_entry (e, struct block_request, elem));
+    }
+  c->busy = NULL;
+  start_batch (c);
+}
+
+/* Called by the interrupt handler when channel C, which is
+   serving a batch, raises an interrupt. */
+static void
+batch_interrupt (struct channel *c) 
+{
+  struct ata_disk *d = c->busy;
+
+  if (c->dma) 
+    {
+      if (!dma_finish (c)) 
+        {
+          printf ("%s: DMA %s failed, sector=%"PRDSNu", retrying with PIO\n",
+                  d->name, c->write ? "write" : "read", c->batch_sector);
+          c->dma = false;
+          rewind_batch (c);
+          start_command (c);
+          return;
+        }
+    }
+  else 
+    {
+      uint8_t status = inb (reg_status (c));      /* Acknowledge interrupt. */
+
+      if ((status & (STA_ERR | STA_DF)) != 0)
+        PANIC ("%s: disk %s failed, sector=%"PRDSNu, d->name,
+               c->write ? "write" : "read", c->sector - c->cmd_left);
+      if (c->cmd_left > 0)
+        {
+          /* A read has the next block ready; a write is ready
+             to take it. */
+          if (!wait_while_busy (d))
+            PANIC ("%s: disk %s failed, sector=%"PRDSNu, d->name,
+                   c->write ? "write" : "read", c->sector - c->cmd_left);
+          pio_block (c);
+          if (c->write || c->cmd_left > 0)
+            return;
+        }
+    }
+
+  /* The command is done.  Start the next one, or finish. */
+  if (c->left > 0)
+    start_command (c);
+  else
+    finish_batch (c);
 }
 
-/* Write sector SEC_NO to disk D from BUFFER, which must contain
-   BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
-   acknowledged receiving the data.
-   Internally synchronizes accesses to disks, so external
-   per-disk locking is unneeded. */
+/* Queues request R for disk D, starting it at once if D's
+   channel is idle. */
 static void
-ide_write (void *d_, block_sector_t sec_no, const void *buffer)
+ide_submit (void *d_, struct block_request *r) 
 {
   struct ata_disk *d = d_;
-  struct channel *c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
-  sema_down (&c->completion_wait);
-  lock_release (&c->lock);
+  enum intr_level old_level = intr_disable ();
+
+  block_queue_add (&d->queue, r);
+  start_batch (d->channel);
+  intr_set_level (old_level);
 }
 
 static struct block_operations ide_operations =
   {
-    ide_read,
-    ide_write
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    ide_submit
   };
-
+
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO to the disk's sector selection registers and CNT
+   to its sector count register.  (We use LBA mode.) */
 static void
-select_sector (struct ata_disk *d, block_sector_t sec_no)
+select_sector (struct ata_disk *d, block_sector_t sec_no, size_t cnt)
 {
   struct channel *c = d->channel;
 
   ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt >= 1 && cnt <= MAX_COMMAND_SECTORS);
   
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  outb (reg_nsect (c), cnt == MAX_COMMAND_SECTORS ? 0 : cnt);
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
@@ -407,8 +746,9 @@ static void
 issue_pio_command (struct channel *c, uint8_t command) 
 {
   /* Interrupts must be enabled or our semaphore will never be
-     up'd by the completion handler. */
-  ASSERT (intr_get_level () == INTR_ON);
+     up'd by the completion handler.  Commands that are part of a
+     batch are instead completed by the handler itself. */
+  ASSERT (c->busy != NULL || intr_get_level () == INTR_ON);
 
   c->expecting_interrupt = true;
   outb (reg_command (c), command);
@@ -430,6 +770,179 @@ output_sector (struct channel *c, const void *sector)
   outsw (reg_data (c), sector, BLOCK_SECTOR_SIZE / 2);
 }
 
+/* Bus master DMA.
+
+   A PCI bus-master IDE controller (see SFF-8038i) adds a few
+   registers per channel that point it at a table of physical
+   region descriptors (PRDs).  Once an ATA READ DMA or WRITE DMA
+   command has been issued and the transfer started, the
+   controller moves the data to or from those regions on its own
+   and raises the usual completion interrupt at the end, so the
+   CPU does not copy anything.
+
+   Request buffers are always in the kernel's address space,
+   whose virtual addresses map directly onto physical memory, so
+   the PRD table can point straight at them.  A batch of merged
+   requests becomes one command whose PRD table scatters the data
+   across all of their buffers. */
+
+/* PCI configuration space access ports. */
+#define PCI_CONFIG_ADDR 0xcf8
+#define PCI_CONFIG_DATA 0xcfc
+
+/* PCI configuration space registers. */
+#define PCI_REG_COMMAND 0x04    /* Command (low 16 bits). */
+#define PCI_REG_CLASS 0x08      /* Class, subclass, prog. i/f, revision. */
+#define PCI_REG_BAR4 0x20       /* Base address 4: bus master registers. */
+
+/* PCI Command register bits. */
+#define PCI_CMD_IO 0x0001       /* Respond to I/O space accesses. */
+#define PCI_CMD_MASTER 0x0004   /* Allow bus mastering. */
+
+/* Reads the 32-bit PCI configuration register REG of function
+   FN of device DEV on bus 0. */
+static uint32_t
+pci_read (int dev, int fn, int reg) 
+{
+  outl (PCI_CONFIG_ADDR, 0x80000000 | (dev << 11) | (fn << 8) | reg);
+  return inl (PCI_CONFIG_DATA);
+}
+
+/* Writes VALUE to the 32-bit PCI configuration register REG of
+   function FN of device DEV on bus 0. */
+static void
+pci_write (int dev, int fn, int reg, uint32_t value) 
+{
+  outl (PCI_CONFIG_ADDR, 0x80000000 | (dev << 11) | (fn << 8) | reg);
+  outl (PCI_CONFIG_DATA, value);
+}
+
+/* Looks on PCI bus 0 for an IDE controller capable of bus
+   mastering, enables bus mastering on it, and returns the I/O
+   base of its bus master registers.  Returns 0 if there is no
+   such controller. */
+static uint16_t
+find_bus_master (void) 
+{
+  int dev, fn;
+
+  for (dev = 0; dev < 32; dev++)
+    for (fn = 0; fn < 8; fn++)
+      {
+        uint32_t class = pci_read (dev, fn, PCI_REG_CLASS);
+        uint32_t bar4;
+
+        if (class == 0xffffffff)
+          continue;
+
+        /* Class 1 (mass storage), subclass 1 (IDE), with the
+           bus master bit set in the programming interface. */
+        if ((class >> 16) != 0x0101 || (class & 0x8000) == 0)
+          continue;
+
+        bar4 = pci_read (dev, fn, PCI_REG_BAR4);
+        if ((bar4 & 1) == 0 || (bar4 & 0xfffc) == 0)
+          continue;
+
+        pci_write (dev, fn, PCI_REG_COMMAND,
+                   pci_read (dev, fn, PCI_REG_COMMAND)
+                   | PCI_CMD_IO | PCI_CMD_MASTER);
+        return bar4 & 0xfffc;
+      }
+  return 0;
+}
+
+/* Sets up channel C to do DMA through the bus master registers
+   at BM_BASE.  Leaves C using PIO if memory runs out. */
+static void
+init_dma (struct channel *c, uint16_t bm_base) 
+{
+  c->prdt = palloc_get_page (0);
+  if (c->prdt == NULL) 
+    {
+      printf ("%s: out of memory, using PIO\n", c->name);
+      return;
+    }
+  c->bm_base = bm_base;
+  printf ("%s: bus master DMA at port 0x%04"PRIx16"\n", c->name, bm_base);
+}
+
+/* Adds PRD entries to channel C's table, starting at *PRD, to
+   describe the SIZE bytes at kernel virtual address BUFFER.
+   Advances *PRD past the entries added. */
+static void
+add_prd (struct channel *c, struct prd **prd, void *buffer, size_t size) 
+{
+  uintptr_t addr = vtop (buffer);
+
+  while (size > 0)
+    {
+      /* A region may not cross a 64 kB boundary. */
+      size_t chunk = 0x10000 - (addr & 0xffff);
+      if (chunk > size)
+        chunk = size;
+
+      ASSERT ((uint8_t *) (*prd + 1) <= (uint8_t *) c->prdt + PGSIZE);
+      (*prd)->addr = addr;
+      (*prd)->size = chunk & 0xffff;
+      (*prd)->flags = 0;
+      (*prd)++;
+      addr += chunk;
+      size -= chunk;
+    }
+}
+
+/* Starts a DMA command for the CNT sectors at channel C's
+   cursor, advancing the cursor past them. */
+static void
+dma_start (struct channel *c, size_t cnt) 
+{
+  uint16_t bm = c->bm_base;
+  block_sector_t sector = c->sector - cnt;
+  struct prd *prd = c->prdt;
+  uint8_t command;
+  size_t left;
+
+  /* Describe the buffers of the requests covered. */
+  for (left = cnt; left > 0; ) 
+    {
+      size_t n = cursor_run (c, left);
+      add_prd (c, &prd, cursor_ptr (c), n * BLOCK_SECTOR_SIZE);
+      cursor_advance (c, n);
+      left -= n;
+    }
+  prd[-1].flags = PRD_EOT;
+
+  /* Point the controller at the PRD table, set the direction, and
+     clear stale status bits. */
+  command = c->write ? 0 : BM_CMD_READ;
+  outl (bm + BM_PRDT, vtop (c->prdt));
+  outb (bm + BM_COMMAND, command);
+  outb (bm + BM_STATUS, inb (bm + BM_STATUS) | BM_STA_ERROR | BM_STA_INTR);
+
+  /* Issue the ATA command, then start the transfer. */
+  select_sector (c->busy, sector, cnt);
+  issue_pio_command (c, c->write ? CMD_WRITE_DMA : CMD_READ_DMA);
+  outb (bm + BM_COMMAND, command | BM_CMD_START);
+}
+
+/* Stops channel C's DMA engine after its completion interrupt
+   and acknowledges the interrupt.  Returns true if the transfer
+   succeeded. */
+static bool
+dma_finish (struct channel *c) 
+{
+  uint16_t bm = c->bm_base;
+  uint8_t status, ata_status;
+
+  outb (bm + BM_COMMAND, c->write ? 0 : BM_CMD_READ);
+  status = inb (bm + BM_STATUS);
+  outb (bm + BM_STATUS, status | BM_STA_ERROR | BM_STA_INTR);
+  ata_status = inb (reg_status (c));
+  return ((status & (BM_STA_ERROR | BM_STA_ACTIVE)) == 0
+          && (ata_status & (STA_ERR | STA_DF)) == 0);
+}
+
 /* Low-level ATA primitives. */
 
 /* Wait up to 10 seconds for the controller to become idle, that
@@ -446,7 +959,7 @@ wait_until_idle (const struct ata_disk *d)
     {
       if ((inb (reg_status (d->channel)) & (STA_BSY | STA_DRQ)) == 0)
         return;
-      timer_usleep (10);
+      timer_udelay (10);
     }
 
   printf ("%s: idle timeout\n", d->name);
@@ -455,7 +968,8 @@ wait_until_idle (const struct ata_disk *d)
 /* Wait up to 30 seconds for disk D to clear BSY,
    and then return the status of the DRQ bit.
    The ATA standards say that a disk may take as long as that to
-   complete its reset. */
+   complete its reset.  Sleeps between polls if interrupts are
+   on, and otherwise busy-waits. */
 static bool
 wait_while_busy (const struct ata_disk *d) 
 {
@@ -472,7 +986,10 @@ wait_while_busy (const struct ata_disk *d)
             printf ("ok\n");
           return (inb (reg_alt_status (c)) & STA_DRQ) != 0;
         }
-      timer_msleep (10);
+      if (intr_get_level () == INTR_ON)
+        timer_msleep (10);
+      else
+        timer_mdelay (10);
     }
 
   printf ("failed\n");
@@ -489,7 +1006,7 @@ select_device (const struct ata_disk *d)
     dev |= DEV_DEV;
   outb (reg_device (c), dev);
   inb (reg_alt_status (c));
-  timer_nsleep (400);
+  timer_ndelay (400);
 }
 
 /* Select disk D in its channel, as select_device(), but wait for
@@ -511,7 +1028,9 @@ interrupt_handler (struct intr_frame *f)
   for (c = channels; c < channels + CHANNEL_CNT; c++)
     if (f->vec_no == c->irq)
       {
-        if (c->expecting_interrupt) 
+        if (c->busy != NULL)
+          batch_interrupt (c);
+        else if (c->expecting_interrupt) 
           {
             inb (reg_status (c));               /* Acknowledge interrupt. */
             sema_up (&c->completion_wait);      /* Wake up waiter. */
@@ -1,6 +1,11 @@
 #ifndef DEVICES_IDE_H
 #define DEVICES_IDE_H
 
+#include <stdbool.h>
+
+/* Use bus master DMA if available?  Set with "-dma". */
+extern bool ide_use_dma;
+
 void ide_init (void);
 
 #endif /* devices/ide.h */
@@ -1,7 +1,6 @@
 #include "devices/serial.h"
 #include <debug.h>
 #include "devices/input.h"
-#include "devices/intq.h"
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
@@ -37,6 +36,13 @@
 #define IER_RECV 0x01           /* Interrupt when data received. */
 #define IER_XMIT 0x02           /* Interrupt when transmit finishes. */
 
+/* FIFO Control Register bits. */
+#define FCR_ENABLE 0x01         /* Enable receive and transmit FIFOs. */
+#define FCR_CLEAR 0x06          /* Clear both FIFOs. */
+
+/* Depth of the 16550A's transmit FIFO, in bytes. */
+#define TX_FIFO_SIZE 16
+
 /* Line Control Register bits. */
 #define LCR_N81 0x03            /* No parity, 8 data bits, 1 stop bit. */
 #define LCR_DLAB 0x80           /* Divisor Latch Access Bit (DLAB). */
@@ -51,11 +57,24 @@
 /* Transmission mode. */
 static enum { UNINIT, POLL, QUEUE } mode;
 
-/* Data to be transmitted. */
-static struct intq txq;
+/* Data to be transmitted.
+
+   This is a circular buffer like struct intq, but much larger,
+   so that a thread can hand over a whole write's worth of
+   output at once and go on running while the interrupt handler
+   drains it into the UART's transmit FIFO. */
+#define TXQ_SIZE 4096
+static uint8_t txq[TXQ_SIZE];
+static size_t txq_head;                 /* New data is written here. */
+static size_t txq_tail;                 /* Old data is read here. */
+static struct thread *txq_waiter;       /* Thread waiting for room. */
 
 static void set_serial (int bps);
 static void putc_poll (uint8_t);
+static bool txq_empty (void);
+static size_t txq_room (void);
+static uint8_t txq_getc (void);
+static void wake_txq_waiter (void);
 static void write_ier (void);
 static intr_handler_func serial_interrupt;
 
@@ -71,7 +90,7 @@ init_poll (void)
   outb (FCR_REG, 0);                    /* Disable FIFO. */
   set_serial (9600);                    /* 9.6 kbps, N-8-1. */
   outb (MCR_REG, MCR_OUT2);             /* Required to enable interrupts. */
-  intq_init (&txq);
+  txq_head = txq_tail = 0;
   mode = POLL;
 } 
 
@@ -88,6 +107,7 @@ serial_init_queue (void)
   ASSERT (mode == POLL);
 
   intr_register_ext (0x20 + 4, serial_interrupt, "serial");
+  outb (FCR_REG, FCR_ENABLE | FCR_CLEAR);  /* Enable FIFO. */
   mode = QUEUE;
   old_level = intr_disable ();
   write_ier ();
@@ -98,31 +118,60 @@ serial_init_queue (void)
 void
 serial_putc (uint8_t byte) 
 {
+  serial_write (&byte, 1);
+}
+
+/* Sends the SIZE bytes in BUFFER to the serial port. */
+void
+serial_write (const void *buffer, size_t size) 
+{
+  const uint8_t *p = buffer;
   enum intr_level old_level = intr_disable ();
 
   if (mode != QUEUE)
     {
       /* If we're not set up for interrupt-driven I/O yet,
-         use dumb polling to transmit a byte. */
+         use dumb polling to transmit the bytes. */
       if (mode == UNINIT)
         init_poll ();
-      putc_poll (byte); 
+      while (size-- > 0)
+        putc_poll (*p++); 
     }
   else 
     {
-      /* Otherwise, queue a byte and update the interrupt enable
-         register. */
-      if (old_level == INTR_OFF && intq_full (&txq)) 
+      /* Otherwise, copy as much as fits into the transmit queue,
+         then wait for the interrupt handler to make room for the
+         rest. */
+      while (size > 0)
         {
-          /* Interrupts are off and the transmit queue is full.
-             If we wanted to wait for the queue to empty,
-             we'd have to reenable interrupts.
-             That's impolite, so we'll send a character via
-             polling instead. */
-          putc_poll (intq_getc (&txq)); 
+          size_t room = txq_room ();
+
+          if (room == 0)
+            {
+              if (old_level == INTR_OFF || intr_context ()
+                  || txq_waiter != NULL)
+                {
+                  /* Interrupts are off and the transmit queue is
+                     full.  If we wanted to wait for the queue to
+                     empty, we'd have to reenable interrupts.
+                     That's impolite, so we'll send a character via
+                     polling instead.  Likewise if another thread
+                     is already waiting, since only one can. */
+                  putc_poll (txq_getc ()); 
+                  continue;
+                }
+              write_ier ();
+              txq_waiter = thread_current ();
+              thread_block ();
+              continue;
+            }
+
+          for (; room > 0 && size > 0; room--, size--)
+            {
+              txq[txq_head] = *p++;
+              txq_head = (txq_head + 1) % TXQ_SIZE;
+            }
         }
-
-      intq_putc (&txq, byte); 
       write_ier ();
     }
   
@@ -135,8 +184,9 @@ void
 serial_flush (void) 
 {
   enum intr_level old_level = intr_disable ();
-  while (!intq_empty (&txq))
-    putc_poll (intq_getc (&txq));
+  while (!txq_empty ())
+    putc_poll (txq_getc ());
+  wake_txq_waiter ();
   intr_set_level (old_level);
 }
 
@@ -182,7 +232,7 @@ write_ier (void)
 
   /* Enable transmit interrupt if we have any characters to
      transmit. */
-  if (!intq_empty (&txq))
+  if (!txq_empty ())
     ier |= IER_XMIT;
 
   /* Enable receive interrupt if we have room to store any
@@ -218,11 +268,62 @@ serial_interrupt (struct intr_frame *f UNUSED)
   while (!input_full () && (inb (LSR_REG) & LSR_DR) != 0)
     input_putc (inb (RBR_REG));
 
-  /* As long as we have a byte to transmit, and the hardware is
-     ready to accept a byte for transmission, transmit a byte. */
-  while (!intq_empty (&txq) && (inb (LSR_REG) & LSR_THRE) != 0) 
-    outb (THR_REG, intq_getc (&txq));
+  /* If the transmit FIFO has drained, refill it in one go.
+     THRE means the whole FIFO is empty, so it has room for
+     TX_FIFO_SIZE bytes without checking again between them. */
+  if (!txq_empty () && (inb (LSR_REG) & LSR_THRE) != 0)
+    {
+      int i;
+
+      for (i = 0; i < TX_FIFO_SIZE && !txq_empty (); i++)
+        outb (THR_REG, txq_getc ());
+      wake_txq_waiter ();
+    }
 
   /* Update interrupt enable register based on queue status. */
   write_ier ();
 }
+
+/* Returns true if the transmit queue is empty. */
+static bool
+txq_empty (void) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  return txq_head == txq_tail;
+}
+
+/* Returns the number of bytes that can be added to the transmit
+   queue.  One slot always stays free, to tell a full queue from
+   an empty one. */
+static size_t
+txq_room (void) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  return (txq_tail + TXQ_SIZE - txq_head - 1) % TXQ_SIZE;
+}
+
+/* Removes a byte from the transmit queue, which must not be
+   empty, and returns it. */
+static uint8_t
+txq_getc (void) 
+{
+  uint8_t byte;
+
+  ASSERT (!txq_empty ());
+  byte = txq[txq_tail];
+  txq_tail = (txq_tail + 1) % TXQ_SIZE;
+  return byte;
+}
+
+/* Wakes up the thread waiting for room in the transmit queue, if
+   any. */
+static void
+wake_txq_waiter (void) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  if (txq_waiter != NULL) 
+    {
+      thread_unblock (txq_waiter);
+      txq_waiter = NULL;
+    }
+}
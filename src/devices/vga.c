@@ -26,6 +26,20 @@ static size_t cx, cy;
    The attribute at (x,y) is fb[y][x][1]. */
 static uint8_t (*fb)[COL_CNT][2];
 
+/* Framebuffer row that currently holds screen row 0.
+
+   Scrolling the screen by moving every row up costs about 4 kB
+   of copying into video memory per line.  While a batch of text
+   is being written, vga_write() instead treats the framebuffer
+   as a circular buffer of rows, so that scrolling only advances
+   this index and clears one row; put_screen() then moves the
+   rows into place once, at the end of the batch.  Outside
+   vga_write() this is always 0. */
+static size_t top;
+
+static uint8_t (*row (size_t y))[2];
+static void put_screen (void);
+static void putc_batched (int c, enum intr_level old_level);
 static void clear_row (size_t y);
 static void cls (void);
 static void newline (void);
@@ -50,13 +64,38 @@ init (void)
    characters in the conventional ways.  */
 void
 vga_putc (int c)
+{
+  char ch = c;
+  vga_write (&ch, 1);
+}
+
+/* Writes the SIZE characters in BUFFER to the VGA text display,
+   interpreting control characters in the conventional ways.
+   Updates the hardware cursor and scrolls the screen only once,
+   at the end. */
+void
+vga_write (const char *buffer, size_t size)
 {
   /* Disable interrupts to lock out interrupt handlers
      that might write to the console. */
   enum intr_level old_level = intr_disable ();
 
   init ();
-  
+  while (size-- > 0)
+    putc_batched (*buffer++, old_level);
+  put_screen ();
+
+  /* Update cursor position. */
+  move_cursor ();
+
+  intr_set_level (old_level);
+}
+
+/* Writes C to the screen as part of a batch started by
+   vga_write(), which turned interrupts off from OLD_LEVEL. */
+static void
+putc_batched (int c, enum intr_level old_level)
+{
   switch (c) 
     {
     case '\n':
@@ -89,30 +128,47 @@ vga_putc (int c)
       break;
       
     default:
-      fb[cy][cx][0] = c;
-      fb[cy][cx][1] = GRAY_ON_BLACK;
+      row (cy)[cx][0] = c;
+      row (cy)[cx][1] = GRAY_ON_BLACK;
       if (++cx >= COL_CNT)
         newline ();
       break;
     }
+}
 
-  /* Update cursor position. */
-  move_cursor ();
+/* Returns the framebuffer row that holds screen row Y. */
+static uint8_t (*row (size_t y))[2]
+{
+  return fb[(top + y) % ROW_CNT];
+}
 
-  intr_set_level (old_level);
+/* Moves the framebuffer rows back into screen order, so that
+   screen row 0 is framebuffer row 0 again. */
+static void
+put_screen (void)
+{
+  static uint8_t tmp[ROW_CNT][COL_CNT][2];
+
+  if (top == 0)
+    return;
+
+  memcpy (tmp, fb, sizeof tmp);
+  memcpy (&fb[0], &tmp[top], sizeof fb[0] * (ROW_CNT - top));
+  memcpy (&fb[ROW_CNT - top], &tmp[0], sizeof fb[0] * top);
+  top = 0;
 }
-
+
 /* Clears the screen and moves the cursor to the upper left. */
 static void
 cls (void)
 {
   size_t y;
 
+  top = 0;
   for (y = 0; y < ROW_CNT; y++)
     clear_row (y);
 
   cx = cy = 0;
-  move_cursor ();
 }
 
 /* Clears row Y to spaces. */
@@ -123,14 +179,15 @@ clear_row (size_t y)
 
   for (x = 0; x < COL_CNT; x++)
     {
-      fb[y][x][0] = ' ';
-      fb[y][x][1] = GRAY_ON_BLACK;
+      row (y)[x][0] = ' ';
+      row (y)[x][1] = GRAY_ON_BLACK;
     }
 }
 
 /* Advances the cursor to the first column in the next line on
    the screen.  If the cursor is already on the last line on the
-   screen, scrolls the screen upward one line. */
+   screen, scrolls the screen upward one line, by rotating the
+   rows; see the comment on TOP. */
 static void
 newline (void)
 {
@@ -139,7 +196,7 @@ newline (void)
   if (cy >= ROW_CNT)
     {
       cy = ROW_CNT - 1;
-      memmove (&fb[0], &fb[1], sizeof fb[0] * (ROW_CNT - 1));
+      top = (top + 1) % ROW_CNT;
       clear_row (ROW_CNT - 1);
     }
 }
@@ -5,6 +5,10 @@
 #include <stdio.h>
 #include <syscall.h>
 
+/* Read buffer.  Large enough that the kernel can move whole runs
+   of sectors straight from the disk into this buffer. */
+static char buffer[32 * 1024];
+
 int
 main (int argc, char *argv[]) 
 {
@@ -22,7 +26,6 @@ main (int argc, char *argv[])
         }
       for (;;) 
         {
-          char buffer[1024];
           int bytes_read = read (fd, buffer, sizeof buffer);
           if (bytes_read == 0)
             break;
@@ -5,6 +5,10 @@ Copies one file to another. */
 #include <stdio.h>
 #include <syscall.h>
 
+/* Copy buffer.  Large enough that the kernel can move whole runs
+   of sectors straight between the disk and this buffer. */
+static char buffer[32 * 1024];
+
 int
 main (int argc, char *argv[]) 
 {
@@ -40,7 +44,6 @@ main (int argc, char *argv[])
   /* Copy data. */
   for (;;) 
     {
-      char buffer[1024];
       int bytes_read = read (in_fd, buffer, sizeof buffer);
       if (bytes_read == 0)
         break;
@@ -0,0 +1,416 @@
+#include "filesys/cache.h"
+#include <debug.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/filesys.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Buffer cache.
+
+   Holds up to CACHE_SECTORS sectors of the file system device in
+   memory.  Reads are served from the cache when possible, and
+   writes only modify the cached copy, which is written back to
+   disk when the entry is evicted, when the flusher thread comes
+   around every FLUSH_INTERVAL ticks, or when the file system is
+   shut down.  Eviction uses the clock algorithm.
+
+   Long runs of whole sectors, as in a large read() or write(),
+   bypass the cache and go straight between the disk and the
+   caller's buffer, so that streaming through a big file does not
+   wipe out the cache.  Sectors of such a run that are already in
+   the cache are served from it, and the cache's copy is checked
+   again after the transfer, so the cache is always up to date.
+
+   Each entry has a lock that protects its data while it is read,
+   written, loaded, or written back.  cache_lock protects the
+   mapping from sectors to entries and the clock hand.  An entry
+   may not be evicted while its pin count is nonzero. */
+
+/* Ticks between runs of the flusher thread. */
+#define FLUSH_INTERVAL TIMER_FREQ
+
+/* A cached sector. */
+struct cache_entry
+  {
+    /* Protected by cache_lock. */
+    block_sector_t sector;      /* Sector held, if VALID. */
+    bool valid;                 /* Does this entry hold a sector? */
+    bool accessed;              /* Used since the clock hand passed? */
+    int pin_cnt;                /* Threads using or waiting for entry. */
+
+    /* Protected by LOCK. */
+    struct lock lock;           /* Held while DATA is in use. */
+    bool dirty;                 /* Changed since last written back? */
+    uint8_t data[BLOCK_SECTOR_SIZE];
+  };
+
+static struct cache_entry *cache;
+static struct lock cache_lock;
+static size_t clock_hand;
+
+static struct cache_entry *cache_get (block_sector_t, bool load);
+static void cache_put (struct cache_entry *);
+static thread_func flush_daemon;
+
+/* Initializes the buffer cache and starts its flusher thread. */
+void
+cache_init (void)
+{
+  size_t i;
+
+  cache = malloc (sizeof *cache * CACHE_SECTORS);
+  if (cache == NULL)
+    PANIC ("Failed to allocate buffer cache");
+  for (i = 0; i < CACHE_SECTORS; i++)
+    {
+      cache[i].valid = false;
+      cache[i].accessed = false;
+      cache[i].pin_cnt = 0;
+      lock_init (&cache[i].lock);
+      cache[i].dirty = false;
+    }
+  lock_init (&cache_lock);
+  clock_hand = 0;
+
+  thread_create ("cache_flush", PRI_DEFAULT, flush_daemon, NULL);
+}
+
+/* Writes every dirty sector in the cache back to disk. */
+void
+cache_flush (void)
+{
+  size_t i;
+
+  for (i = 0; i < CACHE_SECTORS; i++)
+    {
+      struct cache_entry *e = &cache[i];
+
+      lock_acquire (&cache_lock);
+      if (!e->valid)
+        {
+          lock_release (&cache_lock);
+          continue;
+        }
+      e->pin_cnt++;
+      lock_release (&cache_lock);
+
+      lock_acquire (&e->lock);
+      if (e->dirty)
+        {
+          block_write (fs_device, e->sector, e->data);
+          e->dirty = false;
+        }
+      cache_put (e);
+    }
+}
+
+/* Reads SECTOR into BUFFER, which must have room for
+   BLOCK_SECTOR_SIZE bytes. */
+void
+cache_read (block_sector_t sector, void *buffer)
+{
+  struct cache_entry *e = cache_get (sector, true);
+  memcpy (buffer, e->data, BLOCK_SECTOR_SIZE);
+  cache_put (e);
+}
+
+/* Writes the BLOCK_SECTOR_SIZE bytes in BUFFER to SECTOR.  The
+   data reaches the disk later. */
+void
+cache_write (block_sector_t sector, const void *buffer)
+{
+  struct cache_entry *e = cache_get (sector, false);
+  memcpy (e->data, buffer, BLOCK_SECTOR_SIZE);
+  e->dirty = true;
+  cache_put (e);
+}
+
+/* Reads SIZE bytes starting at byte OFS within SECTOR into
+   BUFFER. */
+void
+cache_read_at (block_sector_t sector, void *buffer, size_t ofs, size_t size)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs + size <= BLOCK_SECTOR_SIZE);
+  e = cache_get (sector, true);
+  memcpy (buffer, e->data + ofs, size);
+  cache_put (e);
+}
+
+/* Writes the SIZE bytes in BUFFER to SECTOR, starting at byte
+   OFS within it. */
+void
+cache_write_at (block_sector_t sector, const void *buffer, size_t ofs,
+                size_t size)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs + size <= BLOCK_SECTOR_SIZE);
+  e = cache_get (sector, size < BLOCK_SECTOR_SIZE);
+  memcpy (e->data + ofs, buffer, size);
+  e->dirty = true;
+  cache_put (e);
+}
+
+/* Returns the entry holding SECTOR, or a null pointer if SECTOR
+   is not cached.  The caller must hold cache_lock. */
+static struct cache_entry *
+lookup (block_sector_t sector)
+{
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+  for (i = 0; i < CACHE_SECTORS; i++)
+    if (cache[i].valid && cache[i].sector == sector)
+      return &cache[i];
+  return NULL;
+}
+
+/* Returns the number of sectors, at most CNT, starting at SECTOR
+   that are not in the cache. */
+static size_t
+uncached_run (block_sector_t sector, size_t cnt)
+{
+  size_t i;
+
+  lock_acquire (&cache_lock);
+  for (i = 0; i < cnt; i++)
+    if (lookup (sector + i) != NULL)
+      break;
+  lock_release (&cache_lock);
+  return i;
+}
+
+/* If SECTOR is in the cache, copies its cached data into BUFFER,
+   or, if WRITE is true, copies BUFFER into the cache, and returns
+   true.  Returns false if SECTOR is not cached. */
+static bool
+sync_cached (block_sector_t sector, void *buffer, bool write)
+{
+  struct cache_entry *e;
+
+  lock_acquire (&cache_lock);
+  e = lookup (sector);
+  if (e == NULL)
+    {
+      lock_release (&cache_lock);
+      return false;
+    }
+  e->pin_cnt++;
+  lock_release (&cache_lock);
+
+  lock_acquire (&e->lock);
+  if (write)
+    {
+      memcpy (e->data, buffer, BLOCK_SECTOR_SIZE);
+      e->dirty = true;
+    }
+  else
+    memcpy (buffer, e->data, BLOCK_SECTOR_SIZE);
+  cache_put (e);
+  return true;
+}
+
+/* Reads the CNT sectors starting at SECTOR into BUFFER, which
+   must have room for CNT * BLOCK_SECTOR_SIZE bytes.  Sectors in
+   the cache are copied from it; runs of other sectors are read
+   from disk into BUFFER in one request, without being cached. */
+void
+cache_read_multiple (block_sector_t sector, size_t cnt, void *buffer)
+{
+  uint8_t *p = buffer;
+
+  while (cnt > 0)
+    {
+      size_t n = uncached_run (sector, cnt);
+      size_t i;
+
+      if (n == 0)
+        {
+          cache_read (sector, p);
+          n = 1;
+        }
+      else
+        {
+          block_count_cache (fs_device, n, false);
+          block_read_multiple (fs_device, sector, n, p);
+
+          /* A sector may have been brought into the cache, and
+             changed there, while it was being read.  The cached
+             copy is the current one. */
+          for (i = 0; i < n; i++)
+            sync_cached (sector + i, p + i * BLOCK_SECTOR_SIZE, false);
+        }
+      sector += n;
+      cnt -= n;
+      p += n * BLOCK_SECTOR_SIZE;
+    }
+}
+
+/* Writes the CNT sectors starting at SECTOR from BUFFER, which
+   must contain CNT * BLOCK_SECTOR_SIZE bytes.  Sectors in the
+   cache are updated there; runs of other sectors are written to
+   disk from BUFFER in one request, without being cached. */
+void
+cache_write_multiple (block_sector_t sector, size_t cnt, const void *buffer)
+{
+  const uint8_t *p = buffer;
+
+  while (cnt > 0)
+    {
+      size_t n = uncached_run (sector, cnt);
+      size_t i;
+
+      if (n == 0)
+        {
+          cache_write (sector, p);
+          n = 1;
+        }
+      else
+        {
+          block_count_cache (fs_device, n, false);
+          block_write_multiple (fs_device, sector, n, p);
+
+          /* A sector may have been read into the cache while it
+             was being written, and so hold the old data. */
+          for (i = 0; i < n; i++)
+            sync_cached (sector + i, (void *) (p + i * BLOCK_SECTOR_SIZE),
+                         true);
+        }
+      sector += n;
+      cnt -= n;
+      p += n * BLOCK_SECTOR_SIZE;
+    }
+}
+
+/* Picks an unpinned entry to hold a new sector with the clock
+   algorithm and returns it.  The entry may be dirty, in which
+   case the caller must write it back before reusing it.  Returns
+   a null pointer if every entry is pinned.  The caller must hold
+   cache_lock. */
+static struct cache_entry *
+evict (void)
+{
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+
+  /* Two sweeps clear every accessed bit, so if there is any
+     unpinned entry, one of them is chosen. */
+  for (i = 0; i < 2 * CACHE_SECTORS; i++)
+    {
+      struct cache_entry *e = &cache[clock_hand];
+      clock_hand = (clock_hand + 1) % CACHE_SECTORS;
+
+      if (!e->valid)
+        return e;
+      if (e->pin_cnt > 0)
+        continue;
+      if (e->accessed)
+        {
+          e->accessed = false;
+          continue;
+        }
+      return e;
+    }
+  return NULL;
+}
+
+/* Returns the entry for SECTOR, bringing it into the cache if
+   necessary, pinned and with its lock held.  If LOAD is false
+   and the sector is not cached, its data is not read from disk,
+   because the caller is about to overwrite all of it.  Release
+   the entry with cache_put(). */
+static struct cache_entry *
+cache_get (block_sector_t sector, bool load)
+{
+  struct cache_entry *e;
+
+  lock_acquire (&cache_lock);
+  for (;;)
+    {
+      e = lookup (sector);
+      if (e != NULL)
+        {
+          block_count_cache (fs_device, 1, true);
+          e->accessed = true;
+          e->pin_cnt++;
+          lock_release (&cache_lock);
+          lock_acquire (&e->lock);
+          return e;
+        }
+
+      e = evict ();
+      if (e == NULL)
+        {
+          /* Every entry is in use.  Let their users finish. */
+          lock_release (&cache_lock);
+          thread_yield ();
+          lock_acquire (&cache_lock);
+          continue;
+        }
+
+      /* No other thread can be using the entry, since it is not
+         pinned, so DIRTY can be read without taking its lock. */
+      if (!e->valid || !e->dirty)
+        break;
+
+      /* Write the victim back without holding cache_lock, so that
+         other threads can use the cache meanwhile.  Pinning it
+         keeps it from being chosen again.  Afterward, start over:
+         SECTOR may have been brought in meanwhile, and the victim
+         may have been used again. */
+      e->pin_cnt++;
+      lock_release (&cache_lock);
+      lock_acquire (&e->lock);
+      if (e->dirty)
+        {
+          block_write (fs_device, e->sector, e->data);
+          e->dirty = false;
+        }
+      lock_release (&e->lock);
+      lock_acquire (&cache_lock);
+      e->pin_cnt--;
+    }
+
+  block_count_cache (fs_device, 1, false);
+  e->sector = sector;
+  e->valid = true;
+  e->accessed = true;
+  e->pin_cnt = 1;
+  lock_acquire (&e->lock);
+  lock_release (&cache_lock);
+
+  /* Other threads looking for SECTOR wait on the entry's lock
+     until the data is in. */
+  e->dirty = false;
+  if (load)
+    block_read (fs_device, sector, e->data);
+  return e;
+}
+
+/* Releases entry E, obtained from cache_get(). */
+static void
+cache_put (struct cache_entry *e)
+{
+  lock_release (&e->lock);
+  lock_acquire (&cache_lock);
+  e->pin_cnt--;
+  lock_release (&cache_lock);
+}
+
+/* Writes dirty sectors back to disk every FLUSH_INTERVAL ticks,
+   so that little is lost in a crash and eviction seldom has to
+   wait for a write. */
+static void
+flush_daemon (void *aux UNUSED)
+{
+  for (;;)
+    {
+      timer_sleep (FLUSH_INTERVAL);
+      cache_flush ();
+    }
+}
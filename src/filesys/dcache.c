@@ -0,0 +1,192 @@
+#include "filesys/dcache.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* Directory entry cache.
+
+   Maps a directory's inode sector and a name in that directory to
+   the sector of the inode the name refers to, so that resolving
+   a path does not have to look each component up in its
+   directory.  A name that is known not to exist in a directory
+   is cached too, as a negative entry with sector 0, which is
+   never an inode in a directory because it holds the free map.
+
+   Up to DCACHE_ENTRIES names are cached; the least recently used
+   is dropped to make room.  directory.c keeps the cache up to
+   date: it changes the entries for a directory only while it
+   holds that directory's lock.  dcache_lock protects the cache
+   itself. */
+
+/* A cached name. */
+struct dentry
+  {
+    struct hash_elem hash_elem;         /* Element in dentries. */
+    struct list_elem list_elem;         /* Element in lru_list. */
+    block_sector_t dir;                 /* Directory's inode sector. */
+    char name[NAME_MAX + 1];            /* Name within DIR. */
+    block_sector_t sector;              /* Inode sector, 0 if none. */
+  };
+
+static struct hash dentries;            /* All dentries, by DIR and NAME. */
+static struct list lru_list;            /* Most recently used first. */
+static struct lock dcache_lock;
+
+/* Statistics. */
+static unsigned long long hit_cnt;      /* Found a positive entry. */
+static unsigned long long neg_hit_cnt;  /* Found a negative entry. */
+static unsigned long long miss_cnt;     /* Found nothing. */
+
+static hash_hash_func dentry_hash;
+static hash_less_func dentry_less;
+
+/* Initializes the directory entry cache. */
+void
+dcache_init (void) 
+{
+  if (!hash_init (&dentries, dentry_hash, dentry_less, NULL))
+    PANIC ("Failed to allocate directory entry cache");
+  list_init (&lru_list);
+  lock_init (&dcache_lock);
+}
+
+/* Returns the dentry for NAME in DIR, or a null pointer if there
+   is none.  The caller must hold dcache_lock. */
+static struct dentry *
+find (block_sector_t dir, const char *name) 
+{
+  struct dentry key;
+  struct hash_elem *e;
+
+  ASSERT (lock_held_by_current_thread (&dcache_lock));
+  key.dir = dir;
+  strlcpy (key.name, name, sizeof key.name);
+  e = hash_find (&dentries, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct dentry, hash_elem) : NULL;
+}
+
+/* Looks up NAME in the directory whose inode is in sector DIR.
+   If the cache knows whether NAME exists there, returns true and
+   sets *SECTORP to the sector of its inode, or to 0 if it does
+   not exist.  Otherwise, returns false. */
+bool
+dcache_lookup (block_sector_t dir, const char *name, block_sector_t *sectorp) 
+{
+  struct dentry *d;
+
+  if (strlen (name) > NAME_MAX)
+    return false;
+
+  lock_acquire (&dcache_lock);
+  d = find (dir, name);
+  if (d != NULL)
+    {
+      list_remove (&d->list_elem);
+      list_push_front (&lru_list, &d->list_elem);
+      *sectorp = d->sector;
+      if (d->sector != 0)
+        hit_cnt++;
+      else
+        neg_hit_cnt++;
+    }
+  else
+    miss_cnt++;
+  lock_release (&dcache_lock);
+  return d != NULL;
+}
+
+/* Records that NAME in the directory whose inode is in sector DIR
+   refers to the inode in SECTOR, or, if SECTOR is 0, that there
+   is no such name.  The caller must hold the directory's lock. */
+void
+dcache_insert (block_sector_t dir, const char *name, block_sector_t sector) 
+{
+  struct dentry *d;
+
+  if (strlen (name) > NAME_MAX)
+    return;
+
+  lock_acquire (&dcache_lock);
+  d = find (dir, name);
+  if (d != NULL)
+    list_remove (&d->list_elem);
+  else
+    {
+      if (hash_size (&dentries) >= DCACHE_ENTRIES)
+        {
+          /* Reuse the least recently used entry. */
+          d = list_entry (list_pop_back (&lru_list),
+                          struct dentry, list_elem);
+          hash_delete (&dentries, &d->hash_elem);
+        }
+      else
+        d = malloc (sizeof *d);
+      if (d == NULL)
+        {
+          lock_release (&dcache_lock);
+          return;
+        }
+      d->dir = dir;
+      strlcpy (d->name, name, sizeof d->name);
+      hash_insert (&dentries, &d->hash_elem);
+    }
+  d->sector = sector;
+  list_push_front (&lru_list, &d->list_elem);
+  lock_release (&dcache_lock);
+}
+
+/* Drops every cached name in the directory whose inode is in
+   sector DIR, which is being created anew. */
+void
+dcache_forget_dir (block_sector_t dir) 
+{
+  struct list_elem *e;
+
+  lock_acquire (&dcache_lock);
+  for (e = list_begin (&lru_list); e != list_end (&lru_list); )
+    {
+      struct dentry *d = list_entry (e, struct dentry, list_elem);
+      e = list_next (e);
+      if (d->dir == dir)
+        {
+          list_remove (&d->list_elem);
+          hash_delete (&dentries, &d->hash_elem);
+          free (d);
+        }
+    }
+  lock_release (&dcache_lock);
+}
+
+/* Prints directory entry cache statistics. */
+void
+dcache_print_stats (void) 
+{
+  printf ("Dentry cache: %llu hits, %llu negative hits, %llu misses\n",
+          hit_cnt, neg_hit_cnt, miss_cnt);
+}
+
+/* Returns a hash value for dentry D. */
+static unsigned
+dentry_hash (const struct hash_elem *d_, void *aux UNUSED) 
+{
+  const struct dentry *d = hash_entry (d_, struct dentry, hash_elem);
+  return hash_string (d->name) ^ hash_int (d->dir);
+}
+
+/* Returns true if dentry A precedes dentry B. */
+static bool
+dentry_less (const struct hash_elem *a_, const struct hash_elem *b_,
+             void *aux UNUSED) 
+{
+  const struct dentry *a = hash_entry (a_, struct dentry, hash_elem);
+  const struct dentry *b = hash_entry (b_, struct dentry, hash_elem);
+
+  if (a->dir != b->dir)
+    return a->dir < b->dir;
+  return strcmp (a->name, b->name) < 0;
+}
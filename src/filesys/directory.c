@@ -1,10 +1,13 @@
 #include "filesys/directory.h"
 #include <stdio.h>
 #include <string.h>
+#include <hash.h>
 #include <list.h>
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
 /* A directory. */
 struct dir 
@@ -21,12 +24,113 @@ struct dir_entry
     bool in_use;                        /* In use or free? */
   };
 
+/* Directory indexes.
+
+   Finding a name by reading every entry of a directory takes
+   time proportional to the size of the directory.  Instead, the
+   first lookup in a directory reads all of its entries once and
+   builds an index: a hash table of the entries in use, by name,
+   and a list of the free slots.  Lookups, additions and removals
+   then use the index, and keep it up to date, while holding the
+   directory's lock.
+
+   Indexes are kept for the DIR_INDEX_MAX directories used most
+   recently, by inode sector, even after the directories are
+   closed, because the root directory is opened anew for nearly
+   every file system call.  dir_index_lock protects dir_indexes
+   and the indexes' pin counts; an index in use is pinned, so
+   that it is not freed. */
+
+/* Number of directory indexes kept. */
+#define DIR_INDEX_MAX 8
+
+/* Number of entries read at a time while building an index. */
+#define INDEX_READ_CNT 64
+
+/* Index of a directory's entries. */
+struct dir_index
+  {
+    struct list_elem elem;              /* Element in dir_indexes. */
+    block_sector_t sector;              /* Directory's inode sector. */
+    int pin_cnt;                        /* Number of users. */
+    struct hash names;                  /* Entries in use, by name. */
+    struct list free_slots;             /* Entries not in use. */
+    off_t end;                          /* Offset just past last entry. */
+  };
+
+/* A directory entry, as kept in an index. */
+struct index_entry
+  {
+    struct hash_elem hash_elem;         /* Element in NAMES... */
+    struct list_elem list_elem;         /* ...or in FREE_SLOTS. */
+    char name[NAME_MAX + 1];            /* Name, if in use. */
+    block_sector_t inode_sector;        /* Inode sector, if in use. */
+    off_t ofs;                          /* Byte offset in directory. */
+  };
+
+static struct list dir_indexes;         /* Most recently used first. */
+static struct lock dir_index_lock;
+
+static hash_hash_func index_entry_hash;
+static hash_less_func index_entry_less;
+static void free_index (struct dir_index *);
+
+/* Initializes the directory module. */
+void
+dir_init (void) 
+{
+  list_init (&dir_indexes);
+  lock_init (&dir_index_lock);
+}
+
 /* Creates a directory with space for ENTRY_CNT entries in the
-   given SECTOR.  Returns true if successful, false on failure. */
+   given SECTOR, whose "." and ".." entries refer to SECTOR and
+   PARENT, respectively.  Returns true if successful, false on
+   failure, in which case no sectors other than SECTOR have been
+   allocated. */
 bool
-dir_create (block_sector_t sector, size_t entry_cnt)
+dir_create (block_sector_t sector, block_sector_t parent, size_t entry_cnt)
 {
-  return inode_create (sector, entry_cnt * sizeof (struct dir_entry));
+  struct dir_entry entries[2];
+  struct list_elem *e;
+  struct inode *inode;
+  bool success;
+
+  /* Drop the index of any directory that used to be in SECTOR. */
+  lock_acquire (&dir_index_lock);
+  for (e = list_begin (&dir_indexes); e != list_end (&dir_indexes);
+       e = list_next (e))
+    {
+      struct dir_index *index = list_entry (e, struct dir_index, elem);
+      if (index->sector == sector)
+        {
+          ASSERT (index->pin_cnt == 0);
+          list_remove (e);
+          free_index (index);
+          break;
+        }
+    }
+  lock_release (&dir_index_lock);
+  dcache_forget_dir (sector);
+
+  if (!inode_create (sector, entry_cnt * sizeof (struct dir_entry), true))
+    return false;
+
+  /* Write "." and ".." with a single write within one sector,
+     which either succeeds or writes nothing. */
+  memset (entries, 0, sizeof entries);
+  entries[0].inode_sector = sector;
+  strlcpy (entries[0].name, ".", sizeof entries[0].name);
+  entries[0].in_use = true;
+  entries[1].inode_sector = parent;
+  strlcpy (entries[1].name, "..", sizeof entries[1].name);
+  entries[1].in_use = true;
+  inode = inode_open (sector);
+  success = (inode != NULL
+             && inode_write_at (inode, entries, sizeof entries, 0)
+                == sizeof entries);
+  inode_close (inode);
+  return success;
 }
 
 /* Opens and returns the directory for the given INODE, of which
@@ -83,13 +187,209 @@ dir_get_inode (struct dir *dir)
   return dir->inode;
 }
 
+/* Sets the position in DIR at which dir_readdir() reads next to
+   byte offset POS. */
+void
+dir_seek (struct dir *dir, off_t pos) 
+{
+  ASSERT (pos >= 0);
+  dir->pos = pos;
+}
+
+/* Returns the position in DIR at which dir_readdir() reads
+   next. */
+off_t
+dir_tell (struct dir *dir) 
+{
+  return dir->pos;
+}
+
+/* Returns a hash value for index entry E. */
+static unsigned
+index_entry_hash (const struct hash_elem *e_, void *aux UNUSED) 
+{
+  const struct index_entry *e = hash_entry (e_, struct index_entry,
+                                            hash_elem);
+  return hash_string (e->name);
+}
+
+/* Returns true if index entry A's name precedes index entry B's. */
+static bool
+index_entry_less (const struct hash_elem *a_, const struct hash_elem *b_,
+                  void *aux UNUSED) 
+{
+  const struct index_entry *a = hash_entry (a_, struct index_entry,
+                                            hash_elem);
+  const struct index_entry *b = hash_entry (b_, struct index_entry,
+                                            hash_elem);
+  return strcmp (a->name, b->name) < 0;
+}
+
+/* Frees index entry E, for hash_destroy(). */
+static void
+free_index_entry (struct hash_elem *e, void *aux UNUSED) 
+{
+  free (hash_entry (e, struct index_entry, hash_elem));
+}
+
+/* Frees INDEX, which must not be in dir_indexes. */
+static void
+free_index (struct dir_index *index) 
+{
+  while (!list_empty (&index->free_slots))
+    free (list_entry (list_pop_front (&index->free_slots),
+                      struct index_entry, list_elem));
+  hash_destroy (&index->names, free_index_entry);
+  free (index);
+}
+
+/* Reads all of the entries of the directory in INODE and returns
+   a new index of them, or a null pointer if memory runs out. */
+static struct dir_index *
+build_index (struct inode *inode) 
+{
+  struct dir_index *index;
+  struct dir_entry *buf;
+  off_t ofs = 0;
+  off_t size;
+
+  index = malloc (sizeof *index);
+  buf = malloc (INDEX_READ_CNT * sizeof *buf);
+  if (index == NULL || buf == NULL
+      || !hash_init (&index->names, index_entry_hash, index_entry_less,
+                     NULL))
+    {
+      free (index);
+      free (buf);
+      return NULL;
+    }
+  index->sector = inode_get_inumber (inode);
+  index->pin_cnt = 0;
+  list_init (&index->free_slots);
+
+  while ((size = inode_read_at (inode, buf, INDEX_READ_CNT * sizeof *buf,
+                                ofs)) >= (off_t) sizeof *buf)
+    {
+      size_t cnt = size / sizeof *buf;
+      size_t i;
+
+      for (i = 0; i < cnt; i++, ofs += sizeof *buf)
+        {
+          struct index_entry *e = malloc (sizeof *e);
+          if (e == NULL)
+            {
+              index->end = ofs;
+              free_index (index);
+              free (buf);
+              return NULL;
+            }
+          e->ofs = ofs;
+          if (buf[i].in_use)
+            {
+              strlcpy (e->name, buf[i].name, sizeof e->name);
+              e->inode_sector = buf[i].inode_sector;
+              hash_insert (&index->names, &e->hash_elem);
+            }
+          else
+            list_push_back (&index->free_slots, &e->list_elem);
+        }
+      if (size < (off_t) (INDEX_READ_CNT * sizeof *buf))
+        break;
+    }
+  index->end = ofs;
+  free (buf);
+  return index;
+}
+
+/* Returns the index of DIR, building it if necessary, pinned so
+   that it is not freed until released with put_index().  Returns
+   a null pointer if memory runs out.  The caller must hold DIR's
+   directory lock. */
+static struct dir_index *
+get_index (const struct dir *dir) 
+{
+  block_sector_t sector = inode_get_inumber (dir->inode);
+  struct dir_index *index;
+  struct list_elem *e;
+
+  lock_acquire (&dir_index_lock);
+  for (e = list_begin (&dir_indexes); e != list_end (&dir_indexes);
+       e = list_next (e))
+    {
+      index = list_entry (e, struct dir_index, elem);
+      if (index->sector == sector)
+        {
+          list_remove (e);
+          list_push_front (&dir_indexes, e);
+          index->pin_cnt++;
+          lock_release (&dir_index_lock);
+          return index;
+        }
+    }
+  lock_release (&dir_index_lock);
+
+  /* No other thread can be building this index, because building
+     it requires the directory lock. */
+  index = build_index (dir->inode);
+  if (index == NULL)
+    return NULL;
+
+  lock_acquire (&dir_index_lock);
+  e = list_rbegin (&dir_indexes);
+  while (list_size (&dir_indexes) >= DIR_INDEX_MAX
+         && e != list_rend (&dir_indexes))
+    {
+      struct dir_index *victim = list_entry (e, struct dir_index, elem);
+      e = list_prev (e);
+      if (victim->pin_cnt == 0)
+        {
+          list_remove (&victim->elem);
+          free_index (victim);
+        }
+    }
+  index->pin_cnt = 1;
+  list_push_front (&dir_indexes, &index->elem);
+  lock_release (&dir_index_lock);
+  return index;
+}
+
+/* Releases INDEX, obtained from get_index(). */
+static void
+put_index (struct dir_index *index) 
+{
+  if (index != NULL)
+    {
+      lock_acquire (&dir_index_lock);
+      index->pin_cnt--;
+      lock_release (&dir_index_lock);
+    }
+}
+
+/* Returns INDEX's entry for NAME, or a null pointer if there is
+   none. */
+static struct index_entry *
+index_lookup (struct dir_index *index, const char *name) 
+{
+  struct index_entry key;
+  struct hash_elem *e;
+
+  if (strlen (name) > NAME_MAX)
+    return NULL;
+  strlcpy (key.name, name, sizeof key.name);
+  e = hash_find (&index->names, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct index_entry, hash_elem) : NULL;
+}
+
 /* Searches DIR for a file with the given NAME.
    If successful, returns true, sets *EP to the directory entry
    if EP is non-null, and sets *OFSP to the byte offset of the
    directory entry if OFSP is non-null.
-   otherwise, returns false and ignores EP and OFSP. */
+   otherwise, returns false and ignores EP and OFSP.
+   Uses INDEX, DIR's index, if it is non-null, and otherwise
+   reads DIR's entries one by one.
+   The caller must hold DIR's directory lock. */
 static bool
-lookup (const struct dir *dir, const char *name,
+lookup (const struct dir *dir, struct dir_index *index, const char *name,
         struct dir_entry *ep, off_t *ofsp) 
 {
   struct dir_entry e;
@@ -98,6 +398,22 @@ lookup (const struct dir *dir, const char *name,
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  if (index != NULL)
+    {
+      struct index_entry *ie = index_lookup (index, name);
+      if (ie == NULL)
+        return false;
+      if (ep != NULL)
+        {
+          ep->inode_sector = ie->inode_sector;
+          strlcpy (ep->name, ie->name, sizeof ep->name);
+          ep->in_use = true;
+        }
+      if (ofsp != NULL)
+        *ofsp = ie->ofs;
+      return true;
+    }
+
   for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
        ofs += sizeof e) 
     if (e.in_use && !strcmp (name, e.name)) 
@@ -114,20 +430,41 @@ lookup (const struct dir *dir, const char *name,
 /* Searches DIR for a file with the given NAME
    and returns true if one exists, false otherwise.
    On success, sets *INODE to an inode for the file, otherwise to
-   a null pointer.  The caller must close *INODE. */
+   a null pointer.  The caller must close *INODE.
+   Nothing is found in a directory that has been removed. */
 bool
 dir_lookup (const struct dir *dir, const char *name,
             struct inode **inode) 
 {
-  struct dir_entry e;
+  block_sector_t sector, inode_sector;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  if (lookup (dir, name, &e, NULL))
-    *inode = inode_open (e.inode_sector);
-  else
+  sector = inode_get_inumber (dir->inode);
+  inode_lock_dir (dir->inode);
+  if (inode_is_removed (dir->inode))
     *inode = NULL;
+  else if (dcache_lookup (sector, name, &inode_sector))
+    *inode = inode_sector != 0 ? inode_open (inode_sector) : NULL;
+  else
+    {
+      struct dir_index *index = get_index (dir);
+      struct dir_entry e;
+
+      if (lookup (dir, index, name, &e, NULL))
+        {
+          dcache_insert (sector, name, e.inode_sector);
+          *inode = inode_open (e.inode_sector);
+        }
+      else
+        {
+          dcache_insert (sector, name, 0);
+          *inode = NULL;
+        }
+      put_index (index);
+    }
+  inode_unlock_dir (dir->inode);
 
   return *inode != NULL;
 }
@@ -136,11 +473,13 @@ dir_lookup (const struct dir *dir, const char *name,
    file by that name.  The file's inode is in sector
    INODE_SECTOR.
    Returns true if successful, false on failure.
-   Fails if NAME is invalid (i.e. too long) or a disk or memory
-   error occurs. */
+   Fails if NAME is invalid (i.e. too long), DIR has been removed,
+   or a disk or memory error occurs. */
 bool
 dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
 {
+  struct dir_index *index;
+  struct index_entry *slot = NULL;
   struct dir_entry e;
   off_t ofs;
   bool success = false;
@@ -152,8 +491,13 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   if (*name == '\0' || strlen (name) > NAME_MAX)
     return false;
 
-  /* Check that NAME is not in use. */
-  if (lookup (dir, name, NULL, NULL))
+  /* Check that DIR still exists and NAME is not in use. */
+  inode_lock_dir (dir->inode);
+  index = NULL;
+  if (inode_is_removed (dir->inode))
+    goto done;
+  index = get_index (dir);
+  if (lookup (dir, index, name, NULL, NULL))
     goto done;
 
   /* Set OFS to offset of free slot.
@@ -163,10 +507,26 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
      inode_read_at() will only return a short read at end of file.
      Otherwise, we'd need to verify that we didn't get a short
      read due to something intermittent such as low memory. */
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (!e.in_use)
-      break;
+  if (index != NULL)
+    {
+      if (!list_empty (&index->free_slots))
+        slot = list_entry (list_pop_front (&index->free_slots),
+                           struct index_entry, list_elem);
+      else
+        {
+          slot = malloc (sizeof *slot);
+          if (slot == NULL)
+            goto done;
+          slot->ofs = index->end;
+        }
+      ofs = slot->ofs;
+    }
+  else
+    for (ofs = 0;
+         inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+         ofs += sizeof e) 
+      if (!e.in_use)
+        break;
 
   /* Write slot. */
   e.in_use = true;
@@ -174,16 +534,57 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   e.inode_sector = inode_sector;
   success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
 
+  /* Update index. */
+  if (slot != NULL)
+    {
+      if (!success && ofs < index->end)
+        list_push_front (&index->free_slots, &slot->list_elem);
+      else if (!success)
+        free (slot);
+      else
+        {
+          strlcpy (slot->name, name, sizeof slot->name);
+          slot->inode_sector = inode_sector;
+          hash_insert (&index->names, &slot->hash_elem);
+          if (ofs == index->end)
+            index->end += sizeof e;
+        }
+    }
+  if (success)
+    dcache_insert (inode_get_inumber (dir->inode), name, inode_sector);
+
  done:
+  put_index (index);
+  inode_unlock_dir (dir->inode);
   return success;
 }
 
+/* Returns true if the directory in INODE has no entries other
+   than "." and "..".  The caller must hold INODE's directory
+   lock. */
+static bool
+is_empty (struct inode *inode) 
+{
+  struct dir_entry e;
+  off_t ofs;
+
+  for (ofs = 0; inode_read_at (inode, &e, sizeof e, ofs) == sizeof e;
+       ofs += sizeof e)
+    if (e.in_use && strcmp (e.name, ".") && strcmp (e.name, ".."))
+      return false;
+  return true;
+}
+
 /* Removes any entry for NAME in DIR.
    Returns true if successful, false on failure,
-   which occurs only if there is no file with the given NAME. */
+   which occurs if there is no file with the given NAME, if NAME
+   is "." or "..", or if NAME is a directory that is not empty.
+   A directory that is open, even as a process's working
+   directory, may be removed; nothing more can be created in it. */
 bool
 dir_remove (struct dir *dir, const char *name) 
 {
+  struct dir_index *index;
   struct dir_entry e;
   struct inode *inode = NULL;
   bool success = false;
@@ -192,8 +593,13 @@ dir_remove (struct dir *dir, const char *name)
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  if (!strcmp (name, ".") || !strcmp (name, ".."))
+    return false;
+
   /* Find directory entry. */
-  if (!lookup (dir, name, &e, &ofs))
+  inode_lock_dir (dir->inode);
+  index = get_index (dir);
+  if (!lookup (dir, index, name, &e, &ofs))
     goto done;
 
   /* Open inode. */
@@ -201,23 +607,53 @@ dir_remove (struct dir *dir, const char *name)
   if (inode == NULL)
     goto done;
 
+  /* A directory must be empty.  Holding its lock keeps files from
+     being added to it until it is marked removed. */
+  if (inode_is_dir (inode))
+    {
+      inode_lock_dir (inode);
+      if (!is_empty (inode))
+        {
+          inode_unlock_dir (inode);
+          goto done;
+        }
+    }
+
   /* Erase directory entry. */
   e.in_use = false;
   if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
-    goto done;
+    {
+      if (inode_is_dir (inode))
+        inode_unlock_dir (inode);
+      goto done;
+    }
+
+  /* Move the entry to the index's free slots. */
+  if (index != NULL)
+    {
+      struct index_entry *ie = index_lookup (index, name);
+      hash_delete (&index->names, &ie->hash_elem);
+      list_push_front (&index->free_slots, &ie->list_elem);
+    }
 
   /* Remove inode. */
+  dcache_insert (inode_get_inumber (dir->inode), name, 0);
   inode_remove (inode);
+  if (inode_is_dir (inode))
+    inode_unlock_dir (inode);
   success = true;
 
  done:
+  put_index (index);
+  inode_unlock_dir (dir->inode);
   inode_close (inode);
   return success;
 }
 
 /* Reads the next directory entry in DIR and stores the name in
    NAME.  Returns true if successful, false if the directory
-   contains no more entries. */
+   contains no more entries.  The "." and ".." entries are
+   skipped. */
 bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
 {
@@ -226,7 +662,7 @@ dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
   while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
     {
       dir->pos += sizeof e;
-      if (e.in_use)
+      if (e.in_use && strcmp (e.name, ".") && strcmp (e.name, ".."))
         {
           strlcpy (name, e.name, NAME_MAX + 1);
           return true;
@@ -1,8 +1,76 @@
 #include "filesys/file.h"
 #include <stdio.h>
 #include <debug.h>
+#include <iovec.h>
+#include <list.h>
+#include <round.h>
+#include <string.h>
+#include "devices/block.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Read-ahead.
+
+   A file_read() that starts where the previous one on the same
+   file left off is taken as part of a sequential scan.  After
+   each such read, the read-ahead thread is asked to read the
+   bytes that follow into the file's read-ahead buffer, so that
+   they are in memory by the time the reader asks for them.  The
+   read-ahead window starts at RA_MIN_SIZE bytes and doubles with
+   each sequential read, up to RA_MAX_SIZE; a read anywhere else
+   closes it again.  The read-ahead thread runs at a higher
+   priority than ordinary threads, so that it starts reading as
+   soon as a request is queued.  A read that lands in a window
+   that is still queued or being read waits for it, rather than
+   reading the same sectors itself.
+
+   The buffer is made of single pages, allocated as the window
+   grows, so that a small file never ties up more than it needs
+   and the page pool is not broken up into large blocks.
+
+   A file has at most one read-ahead request outstanding.  Its
+   state is protected by ra_lock.  Data in the buffer is used
+   only if the inode has not been written since it was read. */
+
+/* Smallest and largest read-ahead windows, in bytes. */
+#define RA_MIN_SIZE (8 * BLOCK_SECTOR_SIZE)
+#define RA_MAX_SIZE (64 * BLOCK_SECTOR_SIZE)
+
+/* Most pages in a read-ahead buffer. */
+#define RA_MAX_PAGES DIV_ROUND_UP (RA_MAX_SIZE, PGSIZE)
+
+/* States of a read-ahead buffer. */
+enum ra_state
+  {
+    RA_EMPTY,                   /* Holds nothing. */
+    RA_QUEUED,                  /* Waiting in ra_queue. */
+    RA_BUSY,                    /* Being read by the read-ahead thread. */
+    RA_READY                    /* Holds data. */
+  };
+
+/* A file's read-ahead buffer. */
+struct readahead
+  {
+    struct list_elem elem;      /* Element in ra_queue. */
+    enum ra_state state;        /* State. */
+    struct inode *inode;        /* Inode to read. */
+    off_t start;                /* File offset of first byte in DATA. */
+    off_t length;               /* Bytes to read, or read if RA_READY. */
+    unsigned write_cnt;         /* inode_write_cnt() before reading. */
+    size_t page_cnt;            /* Number of pages allocated. */
+    uint8_t *pages[RA_MAX_PAGES]; /* Buffer, one page at a time. */
+  };
+
+static struct lock ra_lock;
+static struct list ra_queue;            /* Buffers in state RA_QUEUED. */
+static struct condition ra_queued;      /* Signaled when queue grows. */
+static struct condition ra_done;        /* Signaled when a read ends. */
+
+static thread_func read_ahead_daemon;
 
 /* An open file. */
 struct file 
@@ -10,8 +78,22 @@ struct file
     struct inode *inode;        /* File's inode. */
     off_t pos;                  /* Current position. */
     bool deny_write;            /* Has file_deny_write() been called? */
+    off_t next_pos;             /* Position of a sequential next read. */
+    off_t ra_window;            /* Read-ahead window, 0 if closed. */
+    struct readahead *ra;       /* Read-ahead buffer, if allocated. */
   };
 
+/* Starts the read-ahead thread. */
+void
+file_init (void) 
+{
+  lock_init (&ra_lock);
+  list_init (&ra_queue);
+  cond_init (&ra_queued);
+  cond_init (&ra_done);
+  thread_create ("read_ahead", PRI_DEFAULT + 1, read_ahead_daemon, NULL);
+}
+
 /* Opens a file for the given INODE, of which it takes ownership,
    and returns the new file.  Returns a null pointer if an
    allocation fails or if INODE is null. */
@@ -24,6 +106,9 @@ file_open (struct inode *inode)
       file->inode = inode;
       file->pos = 0;
       file->deny_write = false;
+      file->next_pos = 0;
+      file->ra_window = 0;
+      file->ra = NULL;
       return file;
     }
   else
@@ -42,6 +127,30 @@ file_reopen (struct file *file)
   return file_open (inode_reopen (file->inode));
 }
 
+/* Frees FILE's read-ahead buffer, if any, first waiting for the
+   read-ahead thread to finish with it. */
+static void
+free_read_ahead (struct file *file) 
+{
+  struct readahead *ra = file->ra;
+  size_t i;
+
+  if (ra == NULL)
+    return;
+
+  lock_acquire (&ra_lock);
+  if (ra->state == RA_QUEUED)
+    list_remove (&ra->elem);
+  while (ra->state == RA_BUSY)
+    cond_wait (&ra_done, &ra_lock);
+  lock_release (&ra_lock);
+
+  for (i = 0; i < ra->page_cnt; i++)
+    palloc_free_page (ra->pages[i]);
+  free (ra);
+  file->ra = NULL;
+}
+
 /* Closes FILE. */
 void
 file_close (struct file *file) 
@@ -49,6 +158,7 @@ file_close (struct file *file)
   // printf("(%s) File : %p\n",__func__,file->inode);
   if (file != NULL)
     {
+      free_read_ahead (file);
       file_allow_write (file);
       inode_close (file->inode);
       free (file); 
@@ -62,6 +172,148 @@ file_get_inode (struct file *file)
   return file->inode;
 }
 
+/* Copies into BUFFER as many as possible of the SIZE bytes at
+   FILE's current position from FILE's read-ahead buffer, and
+   returns the number of bytes copied.  Waits for the read-ahead
+   thread if those bytes are queued or being read. */
+static off_t
+read_ahead_copy (struct file *file, void *buffer, off_t size) 
+{
+  struct readahead *ra = file->ra;
+  uint8_t *dst = buffer;
+  off_t ofs, copy, left;
+
+  if (ra == NULL)
+    return 0;
+
+  lock_acquire (&ra_lock);
+  if (file->pos < ra->start || file->pos >= ra->start + ra->length)
+    {
+      lock_release (&ra_lock);
+      return 0;
+    }
+  while (ra->state == RA_QUEUED || ra->state == RA_BUSY)
+    cond_wait (&ra_done, &ra_lock);
+  lock_release (&ra_lock);
+
+  /* Only this thread uses the buffer when it is not queued or
+     busy, so there is no need to hold ra_lock while copying. */
+  if (ra->state != RA_READY || ra->write_cnt != inode_write_cnt (file->inode)
+      || file->pos >= ra->start + ra->length)
+    return 0;
+  ofs = file->pos - ra->start;
+  copy = ra->length - ofs;
+  if (copy > size)
+    copy = size;
+  for (left = copy; left > 0; )
+    {
+      size_t page_ofs = ofs % PGSIZE;
+      off_t chunk = PGSIZE - page_ofs;
+      if (chunk > left)
+        chunk = left;
+      memcpy (dst, ra->pages[ofs / PGSIZE] + page_ofs, chunk);
+      dst += chunk;
+      ofs += chunk;
+      left -= chunk;
+    }
+  return copy;
+}
+
+/* Asks the read-ahead thread to read FILE's next RA_WINDOW bytes,
+   starting at its current position, into FILE's read-ahead
+   buffer, unless the buffer already holds them or is in use. */
+static void
+read_ahead (struct file *file) 
+{
+  struct readahead *ra = file->ra;
+  off_t length = inode_length (file->inode) - file->pos;
+
+  if (length <= 0)
+    return;
+  if (length > file->ra_window)
+    length = file->ra_window;
+
+  if (ra == NULL)
+    {
+      ra = malloc (sizeof *ra);
+      if (ra == NULL)
+        return;
+      ra->state = RA_EMPTY;
+      ra->inode = file->inode;
+      ra->start = ra->length = 0;
+      ra->page_cnt = 0;
+      file->ra = ra;
+    }
+
+  lock_acquire (&ra_lock);
+  if (ra->state == RA_EMPTY
+      || (ra->state == RA_READY
+          && (file->pos >= ra->start + ra->length
+              || ra->write_cnt != inode_write_cnt (file->inode))))
+    {
+      /* Grow the buffer to fit the window, or shrink the window
+         to fit the buffer if pages run out. */
+      while (ra->page_cnt < (size_t) DIV_ROUND_UP (length, PGSIZE))
+        {
+          uint8_t *page = palloc_get_page (0);
+          if (page == NULL)
+            break;
+          ra->pages[ra->page_cnt++] = page;
+        }
+      if (length > (off_t) (ra->page_cnt * PGSIZE))
+        length = ra->page_cnt * PGSIZE;
+      if (length == 0)
+        {
+          lock_release (&ra_lock);
+          return;
+        }
+
+      ra->start = file->pos;
+      ra->length = length;
+      ra->state = RA_QUEUED;
+      list_push_back (&ra_queue, &ra->elem);
+      cond_signal (&ra_queued, &ra_lock);
+    }
+  lock_release (&ra_lock);
+}
+
+/* Read-ahead thread.  Fills queued read-ahead buffers, one at a
+   time, in the order they were queued. */
+static void
+read_ahead_daemon (void *aux UNUSED) 
+{
+  lock_acquire (&ra_lock);
+  for (;;)
+    {
+      struct iovec iov[RA_MAX_PAGES];
+      struct readahead *ra;
+      off_t length, left;
+      int iovcnt;
+
+      while (list_empty (&ra_queue))
+        cond_wait (&ra_queued, &ra_lock);
+      ra = list_entry (list_pop_front (&ra_queue), struct readahead, elem);
+      ra->state = RA_BUSY;
+      lock_release (&ra_lock);
+
+      /* RA's owner leaves it alone until it is RA_READY, so
+         LENGTH and PAGES can be read without holding ra_lock. */
+      for (iovcnt = 0, left = ra->length; left > 0; iovcnt++)
+        {
+          iov[iovcnt].iov_base = ra->pages[iovcnt];
+          iov[iovcnt].iov_len = left < PGSIZE ? left : PGSIZE;
+          left -= iov[iovcnt].iov_len;
+        }
+      ra->write_cnt = inode_write_cnt (ra->inode);
+      length = inode_read_iov (ra->inode, iov, iovcnt, ra->start);
+
+      lock_acquire (&ra_lock);
+      ra->length = length;
+      ra->state = RA_READY;
+      cond_broadcast (&ra_done, &ra_lock);
+    }
+}
+
 /* Reads SIZE bytes from FILE into BUFFER,
    starting at the file's current position.
    Returns the number of bytes actually read,
@@ -70,8 +322,28 @@ file_get_inode (struct file *file)
 off_t
 file_read (struct file *file, void *buffer, off_t size) 
 {
-  off_t bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
+  off_t bytes_read;
+
+  if (file->pos == file->next_pos)
+    {
+      file->ra_window = file->ra_window * 2;
+      if (file->ra_window < RA_MIN_SIZE)
+        file->ra_window = RA_MIN_SIZE;
+      if (file->ra_window > RA_MAX_SIZE)
+        file->ra_window = RA_MAX_SIZE;
+    }
+  else
+    file->ra_window = 0;
+
+  bytes_read = read_ahead_copy (file, buffer, size);
+  if (bytes_read < size)
+    bytes_read += inode_read_at (file->inode, (uint8_t *) buffer + bytes_read,
+                                 size - bytes_read, file->pos + bytes_read);
   file->pos += bytes_read;
+  file->next_pos = file->pos;
+
+  if (file->ra_window > 0)
+    read_ahead (file);
   return bytes_read;
 }
 
@@ -89,9 +361,8 @@ file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs)
 /* Writes SIZE bytes from BUFFER into FILE,
    starting at the file's current position.
    Returns the number of bytes actually written,
-   which may be less than SIZE if end of file is reached.
-   (Normally we'd grow the file in that case, but file growth is
-   not yet implemented.)
+   which may be less than SIZE if the disk is full.
+   Writing past end of file extends the file.
    Advances FILE's position by the number of bytes read. */
 off_t
 file_write (struct file *file, const void *buffer, off_t size) 
@@ -104,9 +375,8 @@ file_write (struct file *file, const void *buffer, off_t size)
 /* Writes SIZE bytes from BUFFER into FILE,
    starting at offset FILE_OFS in the file.
    Returns the number of bytes actually written,
-   which may be less than SIZE if end of file is reached.
-   (Normally we'd grow the file in that case, but file growth is
-   not yet implemented.)
+   which may be less than SIZE if the disk is full.
+   Writing past end of file extends the file.
    The file's current position is unaffected. */
 off_t
 file_write_at (struct file *file, const void *buffer, off_t size,
@@ -115,6 +385,33 @@ file_write_at (struct file *file, const void *buffer, off_t size,
   return inode_write_at (file->inode, buffer, size, file_ofs);
 }
 
+/* Reads from FILE into the IOVCNT buffers described by IOV,
+   filling each in turn, starting at the file's current position.
+   Returns the number of bytes actually read,
+   which may be less than requested if end of file is reached.
+   Advances FILE's position by the number of bytes read. */
+off_t
+file_readv (struct file *file, const struct iovec *iov, int iovcnt) 
+{
+  off_t bytes_read = inode_read_iov (file->inode, iov, iovcnt, file->pos);
+  file->pos += bytes_read;
+  return bytes_read;
+}
+
+/* Writes the IOVCNT buffers described by IOV into FILE, one
+   after another, starting at the file's current position.
+   Returns the number of bytes actually written,
+   which may be less than requested if the disk is full.
+   Advances FILE's position by the number of bytes written. */
+off_t
+file_writev (struct file *file, const struct iovec *iov, int iovcnt) 
+{
+  off_t bytes_written = inode_write_iov (file->inode, iov, iovcnt,
+                                         file->pos);
+  file->pos += bytes_written;
+  return bytes_written;
+}
+
 /* Prevents write operations on FILE's underlying inode
    until file_allow_write() is called or FILE is closed. */
 void
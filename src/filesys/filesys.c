@@ -2,15 +2,19 @@
 #include <debug.h>
 #include <stdio.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
+#include "filesys/dcache.h"
 #include "filesys/directory.h"
+#include "threads/thread.h"
 
 /* Partition that contains the file system. */
 struct block *fs_device;
 
 static void do_format (void);
+static bool resolve (const char *path, struct dir **, char name[NAME_MAX + 1]);
 
 /* Initializes the file system module.
    If FORMAT is true, reformats the file system. */
@@ -21,7 +25,11 @@ filesys_init (bool format)
   if (fs_device == NULL)
     PANIC ("No file system device found, can't initialize file system.");
 
+  cache_init ();
   inode_init ();
+  file_init ();
+  dir_init ();
+  dcache_init ();
   free_map_init ();
 
   if (format) 
@@ -35,7 +43,9 @@ filesys_init (bool format)
 void
 filesys_done (void) 
 {
+  inode_flush_all ();
   free_map_close ();
+  cache_flush ();
 }
 
 /* Creates a file named NAME with the given INITIAL_SIZE.
@@ -46,11 +56,12 @@ bool
 filesys_create (const char *name, off_t initial_size) 
 {
   block_sector_t inode_sector = 0;
-  struct dir *dir = dir_open_root ();
-  bool success = (dir != NULL
+  struct dir *dir;
+  char part[NAME_MAX + 1];
+  bool success = (resolve (name, &dir, part)
                   && free_map_allocate (1, &inode_sector)
-                  && inode_create (inode_sector, initial_size)
-                  && dir_add (dir, name, inode_sector));
+                  && inode_create (inode_sector, initial_size, false)
+                  && dir_add (dir, part, inode_sector));
   if (!success && inode_sector != 0) 
     free_map_release (inode_sector, 1);
   dir_close (dir);
@@ -58,7 +69,46 @@ filesys_create (const char *name, off_t initial_size)
   return success;
 }
 
-/* Opens the file with the given NAME.
+/* Creates a directory named NAME.
+   Returns true if successful, false otherwise.
+   Fails if a file named NAME already exists,
+   or if internal memory allocation fails. */
+bool
+filesys_mkdir (const char *name) 
+{
+  block_sector_t inode_sector = 0;
+  struct dir *dir;
+  char part[NAME_MAX + 1];
+  bool success = false;
+
+  if (resolve (name, &dir, part) && free_map_allocate (1, &inode_sector))
+    {
+      block_sector_t parent = inode_get_inumber (dir_get_inode (dir));
+
+      if (!dir_create (inode_sector, parent, 16))
+        free_map_release (inode_sector, 1);
+      else if (dir_add (dir, part, inode_sector))
+        success = true;
+      else
+        {
+          /* Removing the new directory releases its inode sector
+             and the sector holding its "." and ".." entries. */
+          struct inode *inode = inode_open (inode_sector);
+          if (inode != NULL)
+            {
+              inode_remove (inode);
+              inode_close (inode);
+            }
+          else
+            free_map_release (inode_sector, 1);
+        }
+    }
+  dir_close (dir);
+
+  return success;
+}
+
+/* Opens the file with the given NAME, which may be a directory.
    Returns the new file if successful or a null pointer
    otherwise.
    Fails if no file named NAME exists,
@@ -66,38 +116,162 @@ filesys_create (const char *name, off_t initial_size)
 struct file *
 filesys_open (const char *name)
 {
-  struct dir *dir = dir_open_root ();
+  struct dir *dir;
   struct inode *inode = NULL;
+  char part[NAME_MAX + 1];
 
-  if (dir != NULL)
-    dir_lookup (dir, name, &inode);
+  if (resolve (name, &dir, part))
+    {
+      if (part[0] == '\0')
+        inode = inode_reopen (dir_get_inode (dir));
+      else
+        dir_lookup (dir, part, &inode);
+    }
   dir_close (dir);
 
-  // printf("(%s) File : %p\n",__func__,inode);
   return file_open (inode);
 }
 
+/* Opens the directory with the given NAME.
+   Returns the new directory if successful or a null pointer
+   otherwise.
+   Fails if no directory named NAME exists,
+   or if an internal memory allocation fails. */
+struct dir *
+filesys_open_dir (const char *name) 
+{
+  struct dir *dir;
+  struct inode *inode = NULL;
+  char part[NAME_MAX + 1];
+
+  if (!resolve (name, &dir, part))
+    return NULL;
+  if (part[0] == '\0')
+    return dir;
+  dir_lookup (dir, part, &inode);
+  dir_close (dir);
+  if (inode != NULL && !inode_is_dir (inode))
+    {
+      inode_close (inode);
+      return NULL;
+    }
+  return dir_open (inode);
+}
+
 /* Deletes the file named NAME.
    Returns true if successful, false on failure.
-   Fails if no file named NAME exists,
-   or if an internal memory allocation fails. */
+   Fails if no file named NAME exists, if NAME is a directory
+   that is not empty, or if an internal memory allocation
+   fails. */
 bool
 filesys_remove (const char *name) 
 {
-  struct dir *dir = dir_open_root ();
-  bool success = dir != NULL && dir_remove (dir, name);
+  struct dir *dir;
+  char part[NAME_MAX + 1];
+  bool success = resolve (name, &dir, part) && dir_remove (dir, part);
   dir_close (dir); 
 
   return success;
 }
-
+
+/* Extracts a file name part from *SRCP into PART, and updates
+   *SRCP so that the next call will return the next file name
+   part.  Returns 1 if successful, 0 at end of string, -1 for a
+   too-long file name part. */
+static int
+get_next_part (char part[NAME_MAX + 1], const char **srcp) 
+{
+  const char *src = *srcp;
+  char *dst = part;
+
+  /* Skip leading slashes.  If it's all slashes, we're done. */
+  while (*src == '/')
+    src++;
+  if (*src == '\0')
+    return 0;
+
+  /* Copy up to NAME_MAX character from SRC to DST.  Add null
+     terminator. */
+  while (*src != '/' && *src != '\0') 
+    {
+      if (dst < part + NAME_MAX)
+        *dst++ = *src;
+      else
+        return -1;
+      src++; 
+    }
+  *dst = '\0';
+
+  /* Advance source pointer. */
+  *srcp = src;
+  return 1;
+}
+
+/* Opens the directory that holds the last part of PATH, which is
+   relative to the current process's working directory unless it
+   starts with "/", into *DIRP, and copies the last part into
+   NAME.  If PATH names the root directory, sets NAME to "".
+   Returns true if successful.  On failure, returns false and
+   sets *DIRP to a null pointer.  Either way, the caller must
+   close *DIRP. */
+static bool
+resolve (const char *path, struct dir **dirp, char name[NAME_MAX + 1]) 
+{
+  struct dir *dir = NULL;
+  char next[NAME_MAX + 1];
+  int result;
+
+  *dirp = NULL;
+  if (*path == '\0')
+    return false;
+
+  /* Start at the root or the working directory. */
+#ifdef USERPROG
+  if (*path != '/' && thread_current ()->cwd != NULL)
+    dir = dir_reopen (thread_current ()->cwd);
+  else
+#endif
+    dir = dir_open_root ();
+  if (dir == NULL)
+    return false;
+
+  /* Walk down to the directory holding the last part. */
+  result = get_next_part (name, &path);
+  if (result == 0)
+    name[0] = '\0';
+  while (result > 0 && (result = get_next_part (next, &path)) > 0)
+    {
+      struct inode *inode;
+
+      dir_lookup (dir, name, &inode);
+      dir_close (dir);
+      if (inode == NULL || !inode_is_dir (inode))
+        {
+          inode_close (inode);
+          return false;
+        }
+      dir = dir_open (inode);
+      if (dir == NULL)
+        return false;
+      strlcpy (name, next, NAME_MAX + 1);
+    }
+  if (result < 0)
+    {
+      dir_close (dir);
+      return false;
+    }
+
+  *dirp = dir;
+  return true;
+}
+
 /* Formats the file system. */
 static void
 do_format (void)
 {
   printf ("Formatting file system...");
   free_map_create ();
-  if (!dir_create (ROOT_DIR_SECTOR, 16))
+  if (!dir_create (ROOT_DIR_SECTOR, ROOT_DIR_SECTOR, 16))
     PANIC ("root directory creation failed");
   free_map_close ();
   printf ("done.\n");
@@ -4,9 +4,20 @@
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "threads/synch.h"
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
+static size_t free_cnt;              /* Number of free sectors. */
+static size_t reserved_cnt;          /* Free sectors set aside. */
+static struct lock free_map_lock;    /* Protects all of the above. */
+
+/* Sets free_cnt from the free map. */
+static void
+count_free (void) 
+{
+  free_cnt = bitmap_count (free_map, 0, bitmap_size (free_map), false);
+}
 
 /* Initializes the free map. */
 void
@@ -15,17 +26,19 @@ free_map_init (void)
   free_map = bitmap_create (block_size (fs_device));
   if (free_map == NULL)
     PANIC ("bitmap creation failed--file system device is too large");
+  lock_init (&free_map_lock);
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  count_free ();
+  reserved_cnt = 0;
 }
 
-/* Allocates CNT consecutive sectors from the free map and stores
-   the first into *SECTORP.
-   Returns true if successful, false if not enough consecutive
-   sectors were available or if the free_map file could not be
-   written. */
-bool
-free_map_allocate (size_t cnt, block_sector_t *sectorp)
+/* Marks CNT consecutive free sectors as used and returns the
+   first, or returns BITMAP_ERROR if there is no such run or the
+   free map file could not be written.  The caller must hold
+   free_map_lock. */
+static block_sector_t
+take_run (size_t cnt) 
 {
   block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
   if (sector != BITMAP_ERROR
@@ -35,18 +48,94 @@ free_map_allocate (size_t cnt, block_sector_t *sectorp)
       bitmap_set_multiple (free_map, sector, cnt, false); 
       sector = BITMAP_ERROR;
     }
+  if (sector != BITMAP_ERROR)
+    free_cnt -= cnt;
+  return sector;
+}
+
+/* Allocates CNT consecutive sectors from the free map and stores
+   the first into *SECTORP.  Sectors set aside by
+   free_map_reserve() are not used.
+   Returns true if successful, false if not enough consecutive
+   sectors were available or if the free_map file could not be
+   written. */
+bool
+free_map_allocate (size_t cnt, block_sector_t *sectorp)
+{
+  block_sector_t sector = BITMAP_ERROR;
+
+  lock_acquire (&free_map_lock);
+  if (free_cnt - reserved_cnt >= cnt)
+    sector = take_run (cnt);
+  lock_release (&free_map_lock);
   if (sector != BITMAP_ERROR)
     *sectorp = sector;
   return sector != BITMAP_ERROR;
 }
 
+/* Sets aside CNT free sectors, without choosing which, so that a
+   later free_map_allocate_reserved() is sure to find them.
+   Returns true if successful, false if fewer than CNT sectors
+   are free. */
+bool
+free_map_reserve (size_t cnt) 
+{
+  bool success;
+
+  lock_acquire (&free_map_lock);
+  success = free_cnt - reserved_cnt >= cnt;
+  if (success)
+    reserved_cnt += cnt;
+  lock_release (&free_map_lock);
+  return success;
+}
+
+/* Returns CNT sectors set aside by free_map_reserve() to the
+   pool of free sectors. */
+void
+free_map_unreserve (size_t cnt) 
+{
+  lock_acquire (&free_map_lock);
+  ASSERT (reserved_cnt >= cnt);
+  reserved_cnt -= cnt;
+  lock_release (&free_map_lock);
+}
+
+/* Allocates the longest run of consecutive sectors it can find,
+   of at most CNT sectors, from sectors set aside by
+   free_map_reserve().  Stores the first sector into *SECTORP and
+   returns the number allocated, or returns 0 if the free_map
+   file could not be written. */
+size_t
+free_map_allocate_reserved (size_t cnt, block_sector_t *sectorp)
+{
+  block_sector_t sector = BITMAP_ERROR;
+
+  lock_acquire (&free_map_lock);
+  ASSERT (reserved_cnt >= cnt);
+  for (; cnt > 0; cnt /= 2)
+    {
+      sector = take_run (cnt);
+      if (sector != BITMAP_ERROR)
+        break;
+    }
+  reserved_cnt -= cnt;
+  lock_release (&free_map_lock);
+  if (cnt > 0)
+    *sectorp = sector;
+  return cnt;
+}
+
 /* Makes CNT sectors starting at SECTOR available for use. */
 void
 free_map_release (block_sector_t sector, size_t cnt)
 {
+  lock_acquire (&free_map_lock);
   ASSERT (bitmap_all (free_map, sector, cnt));
   bitmap_set_multiple (free_map, sector, cnt, false);
+  free_cnt += cnt;
   bitmap_write (free_map, free_map_file);
+  lock_release (&free_map_lock);
 }
 
 /* Opens the free map file and reads it from disk. */
@@ -58,6 +147,7 @@ free_map_open (void)
     PANIC ("can't open free map");
   if (!bitmap_read (free_map, free_map_file))
     PANIC ("can't read free map");
+  count_free ();
 }
 
 /* Writes the free map to disk and closes the free map file. */
@@ -72,14 +162,23 @@ free_map_close (void)
 void
 free_map_create (void) 
 {
+  struct file *file;
+
   /* Create inode. */
-  if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map)))
+  if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map), false))
     PANIC ("free map creation failed");
 
-  /* Write bitmap to file. */
-  free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
-  if (free_map_file == NULL)
+  /* Write bitmap to file.  Allocating the file's sectors marks
+     them in the free map, so write it again to record them.
+     Until free_map_file is set, allocating sectors does not try
+     to write the free map itself. */
+  file = file_open (inode_open (FREE_MAP_SECTOR));
+  if (file == NULL)
     PANIC ("can't open free map");
-  if (!bitmap_write (free_map, free_map_file))
+  if (!bitmap_write (free_map, file))
+    PANIC ("can't write free map");
+  inode_flush (file_get_inode (file));
+  if (!bitmap_write (free_map, file))
     PANIC ("can't write free map");
+  free_map_file = file;
 }
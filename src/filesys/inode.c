@@ -1,109 +1,591 @@
 #include "filesys/inode.h"
 #include <stdio.h>
-#include <list.h>
+#include <hash.h>
 #include <debug.h>
 #include <round.h>
+#include <stddef.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* File data is stored in extents, each a run of consecutive
+   sectors on disk holding consecutive sectors of the file.  The
+   first INLINE_EXTENTS extents are kept in the inode itself, the
+   rest in a chain of overflow blocks, BLOCK_EXTENTS to a block.
+   Parts of the file not covered by any extent read as zeros.
+
+   Sectors are not allocated when data is first written past end
+   of file or into a hole.  Instead, the data collects in the
+   inode's pending buffer, which holds up to PENDING_SECTORS
+   consecutive sectors of the file, and the free map only sets
+   enough space aside for it.  When the buffer fills up, a write
+   outside it comes along, or the inode is closed, the whole
+   buffer is given the longest runs of free sectors the free map
+   can find, and written out.  Sequentially written files thus
+   end up in a few long extents.  The buffer is made of single
+   pages, allocated as it fills.  If no page can be had, a sector
+   is given its own disk sector right away instead. */
+#define INLINE_EXTENTS 41
+#define BLOCK_EXTENTS 42
+#define PENDING_SECTORS 32
+#define PAGE_SECTORS (PGSIZE / BLOCK_SECTOR_SIZE)
+#define PENDING_PAGES DIV_ROUND_UP (PENDING_SECTORS, PAGE_SECTORS)
+
+/* A run of sectors. */
+struct extent
+  {
+    uint32_t ofs;                       /* First sector within file. */
+    block_sector_t start;               /* First sector on disk. */
+    uint32_t cnt;                       /* Number of sectors. */
+  };
+
 /* On-disk inode.
    Must be exactly BLOCK_SECTOR_SIZE bytes long. */
 struct inode_disk
   {
-    block_sector_t start;               /* First data sector. */
     off_t length;                       /* File size in bytes. */
     unsigned magic;                     /* Magic number. */
-    uint32_t unused[125];               /* Not used. */
+    uint32_t extent_cnt;                /* Number of extents in all. */
+    block_sector_t overflow;            /* First overflow block, or 0. */
+    struct extent extents[INLINE_EXTENTS]; /* First extents. */
+    uint32_t is_dir;                    /* Nonzero for a directory. */
+  };
+
+/* On-disk overflow block.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct extent_block
+  {
+    block_sector_t next;                /* Next overflow block, or 0. */
+    uint32_t unused;                    /* Not used. */
+    struct extent extents[BLOCK_EXTENTS]; /* More extents. */
   };
 
-/* Returns the number of sectors to allocate for an inode SIZE
-   bytes long. */
+/* A sector of zeros. */
+static const uint8_t zeros[BLOCK_SECTOR_SIZE];
+
+/* Returns the number of overflow blocks needed for EXTENT_CNT
+   extents. */
 static inline size_t
-bytes_to_sectors (off_t size)
+overflow_blocks (size_t extent_cnt) 
 {
-  return DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
+  return (extent_cnt > INLINE_EXTENTS
+          ? DIV_ROUND_UP (extent_cnt - INLINE_EXTENTS, BLOCK_EXTENTS)
+          : 0);
 }
 
-/* In-memory inode. */
+/* In-memory inode.
+
+   ELEM, OPEN_CNT and REMOVED are protected by open_inodes_lock.
+   RW is held for reading while the inode's data is read and for
+   writing while it is written, its extents or pending buffer
+   change, or DENY_WRITE_CNT changes, so that different files,
+   and readers of the same file, proceed in parallel.  DIR_LOCK
+   serializes operations on a directory's entries; see
+   directory.c. */
 struct inode 
   {
-    struct list_elem elem;              /* Element in inode list. */
+    struct hash_elem elem;              /* Element in open_inodes. */
     block_sector_t sector;              /* Sector number of disk location. */
     int open_cnt;                       /* Number of openers. */
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+    unsigned write_cnt;                 /* Number of writes so far. */
+    struct rwlock rw;                   /* Readers-writer lock on data. */
+    struct lock dir_lock;               /* Directory entry lock. */
     struct inode_disk data;             /* Inode content. */
+
+    /* Extents, sorted by file sector. */
+    struct extent *extents;             /* All of the inode's extents. */
+    size_t extent_cnt;                  /* Number of extents. */
+    size_t extent_cap;                  /* Number allocated. */
+    block_sector_t *overflow;           /* Overflow blocks' sectors. */
+    size_t overflow_cnt;                /* Number of overflow blocks. */
+    size_t overflow_cap;                /* Number allocated. */
+
+    /* Delayed allocation. */
+    uint8_t *pending[PENDING_PAGES];    /* Pending buffer's pages. */
+    size_t pend_start;                  /* First file sector in PENDING. */
+    size_t pend_cnt;                    /* Number of sectors in PENDING. */
+    size_t pend_reserved;               /* Sectors reserved in free map. */
   };
 
+/* Returns the index of the first of INODE's extents that starts
+   after file sector IDX, or INODE's extent count if there is
+   none, by binary search. */
+static size_t
+extent_upper_bound (const struct inode *inode, size_t idx) 
+{
+  size_t lo = 0, hi = inode->extent_cnt;
+
+  while (lo < hi)
+    {
+      size_t mid = lo + (hi - lo) / 2;
+      if (inode->extents[mid].ofs <= idx)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+  return lo;
+}
+
 /* Returns the block device sector that contains byte offset POS
-   within INODE.
-   Returns -1 if INODE does not contain data for a byte at offset
-   POS. */
+   within INODE, or 0 if no sector has been allocated for it.  If
+   RUN is nonnull, stores the number of sectors from there to the
+   end of the extent that holds it into *RUN. */
 static block_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) 
+byte_to_sector (const struct inode *inode, off_t pos, size_t *run) 
 {
+  size_t idx = pos / BLOCK_SECTOR_SIZE;
+  size_t i;
+
   ASSERT (inode != NULL);
-  if (pos < inode->data.length)
-    return inode->data.start + pos / BLOCK_SECTOR_SIZE;
+  ASSERT (pos >= 0);
+
+  i = extent_upper_bound (inode, idx);
+  if (i > 0)
+    {
+      const struct extent *e = &inode->extents[i - 1];
+      if (idx < e->ofs + e->cnt)
+        {
+          if (run != NULL)
+            *run = e->ofs + e->cnt - idx;
+          return e->start + (idx - e->ofs);
+        }
+    }
+  return 0;
+}
+
+/* Writes INODE's extents to disk: the first ones into the inode
+   sector, the rest into its overflow blocks. */
+static void
+save_extents (struct inode *inode) 
+{
+  size_t cnt = inode->extent_cnt;
+  size_t inline_cnt = cnt < INLINE_EXTENTS ? cnt : INLINE_EXTENTS;
+  size_t i;
+
+  ASSERT (inode->overflow_cnt >= overflow_blocks (cnt));
+
+  inode->data.extent_cnt = cnt;
+  inode->data.overflow = inode->overflow_cnt > 0 ? inode->overflow[0] : 0;
+  memcpy (inode->data.extents, inode->extents,
+          inline_cnt * sizeof *inode->extents);
+  cache_write (inode->sector, &inode->data);
+
+  for (i = 0; i < inode->overflow_cnt; i++)
+    {
+      block_sector_t next = (i + 1 < inode->overflow_cnt
+                             ? inode->overflow[i + 1] : 0);
+      size_t first = INLINE_EXTENTS + i * BLOCK_EXTENTS;
+      size_t n = cnt > first ? cnt - first : 0;
+      if (n > BLOCK_EXTENTS)
+        n = BLOCK_EXTENTS;
+
+      cache_write_at (inode->overflow[i], &next,
+                      offsetof (struct extent_block, next), sizeof next);
+      if (n > 0)
+        cache_write_at (inode->overflow[i], inode->extents + first,
+                        offsetof (struct extent_block, extents),
+                        n * sizeof *inode->extents);
+    }
+}
+
+/* Reads INODE's extents, whose first ones are in INODE->data,
+   from disk.  Returns true if successful, false if memory
+   allocation fails. */
+static bool
+load_extents (struct inode *inode) 
+{
+  size_t cnt = inode->data.extent_cnt;
+  size_t blocks = overflow_blocks (cnt);
+  block_sector_t sector = inode->data.overflow;
+  size_t i;
+
+  inode->extent_cnt = inode->extent_cap = cnt;
+  inode->overflow_cnt = inode->overflow_cap = blocks;
+  inode->extents = malloc (cnt * sizeof *inode->extents);
+  inode->overflow = malloc (blocks * sizeof *inode->overflow);
+  if ((cnt > 0 && inode->extents == NULL)
+      || (blocks > 0 && inode->overflow == NULL))
+    {
+      free (inode->extents);
+      free (inode->overflow);
+      return false;
+    }
+
+  memcpy (inode->extents, inode->data.extents,
+          (cnt < INLINE_EXTENTS ? cnt : INLINE_EXTENTS)
+          * sizeof *inode->extents);
+  for (i = 0; i < blocks; i++)
+    {
+      size_t first = INLINE_EXTENTS + i * BLOCK_EXTENTS;
+      size_t n = cnt - first < BLOCK_EXTENTS ? cnt - first : BLOCK_EXTENTS;
+
+      inode->overflow[i] = sector;
+      cache_read_at (sector, inode->extents + first,
+                     offsetof (struct extent_block, extents),
+                     n * sizeof *inode->extents);
+      cache_read_at (sector, &sector, offsetof (struct extent_block, next),
+                     sizeof sector);
+    }
+  return true;
+}
+
+/* Allocates a sector, from the inode's reservation if it has
+   any left, and stores it in *SECTORP.  Returns true if
+   successful, false if the disk is full. */
+static bool
+allocate_sector (struct inode *inode, block_sector_t *sectorp) 
+{
+  if (inode->pend_reserved > 0
+      && free_map_allocate_reserved (1, sectorp) == 1)
+    {
+      inode->pend_reserved--;
+      return true;
+    }
+  return free_map_allocate (1, sectorp);
+}
+
+/* Makes room in memory for CNT more of INODE's extents and the
+   overflow blocks they may need, so that adding them later
+   cannot fail for lack of memory.  Returns true if successful,
+   false if memory allocation fails. */
+static bool
+reserve_extents (struct inode *inode, size_t cnt) 
+{
+  size_t need = inode->extent_cnt + cnt;
+  size_t blocks = overflow_blocks (need);
+
+  if (need > inode->extent_cap)
+    {
+      size_t cap = inode->extent_cap > 0 ? inode->extent_cap * 2 : 8;
+      struct extent *e;
+
+      if (cap < need)
+        cap = need;
+      e = realloc (inode->extents, cap * sizeof *e);
+      if (e == NULL)
+        return false;
+      inode->extents = e;
+      inode->extent_cap = cap;
+    }
+  if (blocks > inode->overflow_cap)
+    {
+      block_sector_t *overflow;
+
+      overflow = realloc (inode->overflow, blocks * sizeof *overflow);
+      if (overflow == NULL)
+        return false;
+      inode->overflow = overflow;
+      inode->overflow_cap = blocks;
+    }
+  return true;
+}
+
+/* Records that the CNT file sectors starting at OFS of INODE are
+   stored in the CNT disk sectors starting at START, merging the
+   new extent with its neighbors where they are contiguous.  The
+   extents are not saved to disk.  Returns true if successful,
+   false if memory or an overflow block could not be allocated. */
+static bool
+add_extent (struct inode *inode, size_t ofs, block_sector_t start,
+            size_t cnt) 
+{
+  struct extent *e;
+  size_t i = extent_upper_bound (inode, ofs);
+  bool merge_prev, merge_next;
+
+  e = inode->extents;
+  merge_prev = (i > 0 && e[i - 1].ofs + e[i - 1].cnt == ofs
+                && e[i - 1].start + e[i - 1].cnt == start);
+  merge_next = (i < inode->extent_cnt && ofs + cnt == e[i].ofs
+                && start + cnt == e[i].start);
+  if (merge_prev && merge_next)
+    {
+      e[i - 1].cnt += cnt + e[i].cnt;
+      memmove (e + i, e + i + 1, (inode->extent_cnt - i - 1) * sizeof *e);
+      inode->extent_cnt--;
+      return true;
+    }
+  else if (merge_prev)
+    {
+      e[i - 1].cnt += cnt;
+      return true;
+    }
+  else if (merge_next)
+    {
+      e[i].ofs = ofs;
+      e[i].start = start;
+      e[i].cnt += cnt;
+      return true;
+    }
+
+  /* Make room for a new extent, in memory and on disk. */
+  if (!reserve_extents (inode, 1))
+    return false;
+  e = inode->extents;
+  if (overflow_blocks (inode->extent_cnt + 1) > inode->overflow_cnt)
+    {
+      block_sector_t sector;
+
+      if (!allocate_sector (inode, &sector))
+        return false;
+      inode->overflow[inode->overflow_cnt++] = sector;
+    }
+
+  memmove (e + i + 1, e + i, (inode->extent_cnt - i) * sizeof *e);
+  e[i].ofs = ofs;
+  e[i].start = start;
+  e[i].cnt = cnt;
+  inode->extent_cnt++;
+  return true;
+}
+
+/* Frees the pages of INODE's pending buffer. */
+static void
+free_pending (struct inode *inode) 
+{
+  size_t i;
+
+  for (i = 0; i < PENDING_PAGES; i++)
+    if (inode->pending[i] != NULL)
+      {
+        palloc_free_page (inode->pending[i]);
+        inode->pending[i] = NULL;
+      }
+}
+
+/* Allocates disk sectors for INODE's pending buffer, writes the
+   buffer to them, and frees it.  This cannot fail, because
+   pending_sector() set aside the sectors, including one for an
+   overflow block, and the memory for the extents when it
+   accepted the data.  The caller must hold INODE's rw lock for
+   writing. */
+static void
+flush_pending (struct inode *inode) 
+{
+  size_t done = 0;
+  size_t i;
+
+  while (done < inode->pend_cnt)
+    {
+      size_t left = inode->pend_cnt - done;
+      block_sector_t start;
+      size_t cnt = free_map_allocate_reserved (left, &start);
+      if (cnt == 0)
+        PANIC ("reserved sectors not available");
+      inode->pend_reserved -= cnt;
+
+      /* Write the run a page of the buffer at a time. */
+      for (i = 0; i < cnt; )
+        {
+          size_t sec = done + i;
+          size_t n = PAGE_SECTORS - sec % PAGE_SECTORS;
+          if (n > cnt - i)
+            n = cnt - i;
+          cache_write_multiple (start + i, n,
+                                inode->pending[sec / PAGE_SECTORS]
+                                + sec % PAGE_SECTORS * BLOCK_SECTOR_SIZE);
+          i += n;
+        }
+      if (!add_extent (inode, inode->pend_start + done, start, cnt))
+        PANIC ("reserved extent space not available");
+      done += cnt;
+    }
+  if (done > 0)
+    save_extents (inode);
+
+  free_map_unreserve (inode->pend_reserved);
+  inode->pend_reserved = 0;
+  inode->pend_cnt = 0;
+  free_pending (inode);
+}
+
+/* Returns INODE's pending copy of file sector IDX, or a null
+   pointer if IDX is not pending. */
+static uint8_t *
+pending_lookup (const struct inode *inode, size_t idx) 
+{
+  if (inode->pend_cnt > 0 && idx >= inode->pend_start
+      && idx < inode->pend_start + inode->pend_cnt)
+    {
+      size_t sec = idx - inode->pend_start;
+      return (inode->pending[sec / PAGE_SECTORS]
+              + sec % PAGE_SECTORS * BLOCK_SECTOR_SIZE);
+    }
   else
-    return -1;
+    return NULL;
+}
+
+/* Returns INODE's pending copy of file sector IDX, which must not
+   have a disk sector, adding it to the pending buffer, filled
+   with zeros, if it is not there yet.  This may flush the
+   pending buffer to make room.  Returns a null pointer if memory
+   allocation fails or the disk is full.  The caller must hold
+   INODE's rw lock for writing. */
+static uint8_t *
+pending_sector (struct inode *inode, size_t idx) 
+{
+  uint8_t *p = pending_lookup (inode, idx);
+  size_t page, reserve;
+
+  if (p != NULL)
+    return p;
+
+  if (inode->pend_cnt > 0
+      && (idx != inode->pend_start + inode->pend_cnt
+          || inode->pend_cnt == PENDING_SECTORS))
+    flush_pending (inode);
+
+  /* Get the page the sector goes in.  If no page is free, flush
+     the buffer, which frees its pages, and start over. */
+  page = inode->pend_cnt / PAGE_SECTORS;
+  if (inode->pending[page] == NULL)
+    {
+      inode->pending[page] = palloc_get_page (0);
+      if (inode->pending[page] == NULL && inode->pend_cnt > 0)
+        {
+          flush_pending (inode);
+          page = 0;
+          inode->pending[page] = palloc_get_page (0);
+        }
+      if (inode->pending[page] == NULL)
+        return NULL;
+    }
+
+  /* Set aside memory for the extents that flushing the buffer
+     may add, at worst one per sector.  A new buffer also sets
+     aside a sector for the overflow block that its extents might
+     need; fewer than BLOCK_EXTENTS extents never need two. */
+  if (!reserve_extents (inode, inode->pend_cnt + 1))
+    return NULL;
+  reserve = inode->pend_cnt == 0 ? 2 : 1;
+  if (!free_map_reserve (reserve))
+    return NULL;
+  inode->pend_reserved += reserve;
+  if (inode->pend_cnt == 0)
+    inode->pend_start = idx;
+
+  p = (inode->pending[page]
+       + inode->pend_cnt++ % PAGE_SECTORS * BLOCK_SECTOR_SIZE);
+  memset (p, 0, BLOCK_SECTOR_SIZE);
+  return p;
+}
+
+/* Gives file sector IDX of INODE, which must have no disk sector
+   and not be pending, a disk sector of its own right away, filled
+   with zeros, and returns it.  This is the fallback when no page
+   can be had for the pending buffer.  Returns 0 if the disk is
+   full or memory allocation fails.  The caller must hold INODE's
+   rw lock for writing. */
+static block_sector_t
+map_sector (struct inode *inode, size_t idx) 
+{
+  block_sector_t sector;
+
+  /* Flushing first keeps add_extent() from taking an overflow
+     block out of the pending buffer's reservation. */
+  if (inode->pend_cnt > 0)
+    flush_pending (inode);
+
+  if (!free_map_allocate (1, &sector))
+    return 0;
+  if (!add_extent (inode, idx, sector, 1))
+    {
+      free_map_release (sector, 1);
+      return 0;
+    }
+  cache_write (sector, zeros);
+  save_extents (inode);
+  return sector;
+}
+
+/* Releases all of the data and overflow sectors of INODE, and
+   drops its pending data. */
+static void
+release_sectors (struct inode *inode) 
+{
+  size_t i;
+
+  for (i = 0; i < inode->extent_cnt; i++)
+    free_map_release (inode->extents[i].start, inode->extents[i].cnt);
+  for (i = 0; i < inode->overflow_cnt; i++)
+    free_map_release (inode->overflow[i], 1);
+  free_map_unreserve (inode->pend_reserved);
+  inode->pend_reserved = 0;
+  inode->pend_cnt = 0;
 }
 
-/* List of open inodes, so that opening a single inode twice
+/* Open inodes, by sector, so that opening a single inode twice
    returns the same `struct inode'. */
-static struct list open_inodes;
+static struct hash open_inodes;
+
+/* Statistics. */
+static unsigned long long open_cnt;     /* Calls to inode_open(). */
+static unsigned long long open_hit_cnt; /* Inode was already open. */
+static unsigned long long reopen_cnt;   /* Calls to inode_reopen(). */
+
+/* Protects all of the above and each open inode's open count. */
+static struct lock open_inodes_lock;
+
+static struct inode *find_open_inode (block_sector_t);
+static hash_hash_func inode_hash;
+static hash_less_func inode_less;
 
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
-  list_init (&open_inodes);
+  if (!hash_init (&open_inodes, inode_hash, inode_less, NULL))
+    PANIC ("Failed to allocate open inode table");
+  lock_init (&open_inodes_lock);
+}
+
+/* Prints statistics on opening inodes. */
+void
+inode_print_stats (void) 
+{
+  printf ("Inodes: %llu opens (%llu already open), %llu reopens\n",
+          open_cnt, open_hit_cnt, reopen_cnt);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
    writes the new inode to sector SECTOR on the file system
-   device.
+   device.  The inode holds a directory if IS_DIR is true, and
+   otherwise an ordinary file.  The data reads as zeros; no
+   sectors are allocated for it until it is written.
    Returns true if successful.
-   Returns false if memory or disk allocation fails. */
+   Returns false if memory allocation fails. */
 bool
-inode_create (block_sector_t sector, off_t length)
+inode_create (block_sector_t sector, off_t length, bool is_dir)
 {
   struct inode_disk *disk_inode = NULL;
-  bool success = false;
 
   ASSERT (length >= 0);
 
-  /* If this assertion fails, the inode structure is not exactly
-     one sector in size, and you should fix that. */
+  /* If these assertions fail, the inode or overflow block
+     structure is not exactly one sector in size, and you should
+     fix that. */
   ASSERT (sizeof *disk_inode == BLOCK_SECTOR_SIZE);
+  ASSERT (sizeof (struct extent_block) == BLOCK_SECTOR_SIZE);
 
   disk_inode = calloc (1, sizeof *disk_inode);
-  if (disk_inode != NULL)
-    {
-      size_t sectors = bytes_to_sectors (length);
-      disk_inode->length = length;
-      disk_inode->magic = INODE_MAGIC;
-      if (free_map_allocate (sectors, &disk_inode->start)) 
-        {
-          block_write (fs_device, sector, disk_inode);
-          if (sectors > 0) 
-            {
-              static char zeros[BLOCK_SECTOR_SIZE];
-              size_t i;
-              
-              for (i = 0; i < sectors; i++) 
-                block_write (fs_device, disk_inode->start + i, zeros);
-            }
-          success = true; 
-        } 
-      free (disk_inode);
-    }
-  return success;
+  if (disk_inode == NULL)
+    return false;
+  disk_inode->length = length;
+  disk_inode->magic = INODE_MAGIC;
+  disk_inode->is_dir = is_dir;
+  cache_write (sector, disk_inode);
+  free (disk_inode);
+  return true;
 }
 
 /* Reads an inode from SECTOR
@@ -112,42 +594,110 @@ inode_create (block_sector_t sector, off_t length)
 struct inode *
 inode_open (block_sector_t sector)
 {
-  struct list_elem *e;
-  struct inode *inode;
+  struct inode *inode, *open;
 
   /* Check whether this inode is already open. */
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e)) 
-    {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector) 
-        {
-          inode_reopen (inode);
-          return inode; 
-        }
-    }
+  lock_acquire (&open_inodes_lock);
+  open_cnt++;
+  inode = find_open_inode (sector);
+  if (inode != NULL)
+    open_hit_cnt++;
+  lock_release (&open_inodes_lock);
+  if (inode != NULL)
+    return inode;
 
   /* Allocate memory. */
   inode = malloc (sizeof *inode);
   if (inode == NULL)
     return NULL;
 
-  /* Initialize. */
-  list_push_front (&open_inodes, &inode->elem);
+  /* Initialize.  The disk read is done without holding
+     open_inodes_lock, so another thread may open the same inode
+     meanwhile, in which case we use its copy. */
   inode->sector = sector;
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
+  inode->write_cnt = 0;
   inode->removed = false;
-  block_read (fs_device, inode->sector, &inode->data);
+  rwlock_init (&inode->rw);
+  lock_init (&inode->dir_lock);
+  cache_read (inode->sector, &inode->data);
+  if (!load_extents (inode))
+    {
+      free (inode);
+      return NULL;
+    }
+  memset (inode->pending, 0, sizeof inode->pending);
+  inode->pend_start = inode->pend_cnt = inode->pend_reserved = 0;
+
+  lock_acquire (&open_inodes_lock);
+  open = find_open_inode (sector);
+  if (open == NULL)
+    hash_insert (&open_inodes, &inode->elem);
+  lock_release (&open_inodes_lock);
+
+  if (open != NULL)
+    {
+      free (inode->extents);
+      free (inode->overflow);
+      free (inode);
+      inode = open;
+    }
   return inode;
 }
 
+/* Returns the open inode for SECTOR with its open count
+   incremented, or a null pointer if it is not open.  The caller
+   must hold open_inodes_lock. */
+static struct inode *
+find_open_inode (block_sector_t sector) 
+{
+  struct inode key;
+  struct hash_elem *e;
+
+  ASSERT (lock_held_by_current_thread (&open_inodes_lock));
+
+  key.sector = sector;
+  e = hash_find (&open_inodes, &key.elem);
+  if (e == NULL)
+    return NULL;
+  else
+    {
+      struct inode *inode = hash_entry (e, struct inode, elem);
+      inode->open_cnt++;
+      return inode;
+    }
+}
+
+/* Returns a hash value for inode I. */
+static unsigned
+inode_hash (const struct hash_elem *i_, void *aux UNUSED) 
+{
+  const struct inode *i = hash_entry (i_, struct inode, elem);
+  return hash_int (i->sector);
+}
+
+/* Returns true if inode A's sector precedes inode B's. */
+static bool
+inode_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED) 
+{
+  const struct inode *a = hash_entry (a_, struct inode, elem);
+  const struct inode *b = hash_entry (b_, struct inode, elem);
+  return a->sector < b->sector;
+}
+
 /* Reopens and returns INODE. */
 struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    {
+      lock_acquire (&open_inodes_lock);
+      inode->open_cnt++;
+      reopen_cnt++;
+      lock_release (&open_inodes_lock);
+    }
   return inode;
 }
 
@@ -164,67 +714,256 @@ inode_get_inumber (const struct inode *inode)
 void
 inode_close (struct inode *inode) 
 {
+  bool last;
+
   /* Ignore null pointer. */
   if (inode == NULL)
     return;
+
+  /* Write out pending data while INODE is still in open_inodes,
+     so that reopening it cannot find stale extents on disk.
+     Every opener does so, so the last one finds nothing left. */
+  inode_flush (inode);
   
   /* Release resources if this was the last opener. */
-  if (--inode->open_cnt == 0)
+  lock_acquire (&open_inodes_lock);
+  last = --inode->open_cnt == 0;
+  if (last)
+    hash_delete (&open_inodes, &inode->elem);
+  lock_release (&open_inodes_lock);
+
+  if (last)
     {
-      /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
- 
       /* Deallocate blocks if removed. */
       if (inode->removed) 
         {
           free_map_release (inode->sector, 1);
-          free_map_release (inode->data.start,
-                            bytes_to_sectors (inode->data.length)); 
+          release_sectors (inode);
         }
 
+      free_pending (inode);
+      free (inode->extents);
+      free (inode->overflow);
       free (inode); 
     }
 }
 
+/* Returns true if INODE holds a directory. */
+bool
+inode_is_dir (const struct inode *inode) 
+{
+  return inode->data.is_dir != 0;
+}
+
+/* Returns true if INODE has been removed with inode_remove(). */
+bool
+inode_is_removed (struct inode *inode) 
+{
+  bool removed;
+
+  lock_acquire (&open_inodes_lock);
+  removed = inode->removed;
+  lock_release (&open_inodes_lock);
+  return removed;
+}
+
 /* Marks INODE to be deleted when it is closed by the last caller who
    has it open. */
 void
 inode_remove (struct inode *inode) 
 {
   ASSERT (inode != NULL);
+  lock_acquire (&open_inodes_lock);
   inode->removed = true;
+  lock_release (&open_inodes_lock);
+}
+
+/* Position within an array of iovecs. */
+struct iov_iter 
+  {
+    const struct iovec *iov;            /* Current segment. */
+    int cnt;                            /* Segments left, counting IOV. */
+    size_t ofs;                         /* Offset within IOV. */
+  };
+
+/* Initializes IT to the start of the CNT segments in IOV. */
+static void
+iov_iter_init (struct iov_iter *it, const struct iovec *iov, int cnt) 
+{
+  it->iov = iov;
+  it->cnt = cnt;
+  it->ofs = 0;
+  while (it->cnt > 0 && it->iov->iov_len == 0)
+    {
+      it->iov++;
+      it->cnt--;
+    }
+}
+
+/* Returns the number of bytes left in IT's current segment. */
+static size_t
+iov_iter_left (const struct iov_iter *it) 
+{
+  return it->cnt > 0 ? it->iov->iov_len - it->ofs : 0;
+}
+
+/* Returns a pointer to IT's current position. */
+static uint8_t *
+iov_iter_ptr (const struct iov_iter *it) 
+{
+  return (uint8_t *) it->iov->iov_base + it->ofs;
+}
+
+/* Advances IT by SIZE bytes, moving on to later segments as
+   needed. */
+static void
+iov_iter_advance (struct iov_iter *it, size_t size) 
+{
+  while (size > 0 && it->cnt > 0)
+    {
+      size_t n = size < iov_iter_left (it) ? size : iov_iter_left (it);
+      it->ofs += n;
+      size -= n;
+      if (it->ofs == it->iov->iov_len)
+        {
+          it->iov++;
+          it->cnt--;
+          it->ofs = 0;
+        }
+    }
+  while (it->cnt > 0 && it->iov->iov_len == 0)
+    {
+      it->iov++;
+      it->cnt--;
+    }
+}
+
+/* Copies SIZE bytes from BUFFER to IT's position, advancing IT. */
+static void
+iov_iter_copy_out (struct iov_iter *it, const uint8_t *buffer, size_t size) 
+{
+  while (size > 0 && it->cnt > 0)
+    {
+      size_t n = size < iov_iter_left (it) ? size : iov_iter_left (it);
+      memcpy (iov_iter_ptr (it), buffer, n);
+      iov_iter_advance (it, n);
+      buffer += n;
+      size -= n;
+    }
+}
+
+/* Copies SIZE bytes from IT's position to BUFFER, advancing IT. */
+static void
+iov_iter_copy_in (struct iov_iter *it, uint8_t *buffer, size_t size) 
+{
+  while (size > 0 && it->cnt > 0)
+    {
+      size_t n = size < iov_iter_left (it) ? size : iov_iter_left (it);
+      memcpy (buffer, iov_iter_ptr (it), n);
+      iov_iter_advance (it, n);
+      buffer += n;
+      size -= n;
+    }
+}
+
+/* Returns the total length of the CNT segments in IOV. */
+static off_t
+iov_length (const struct iovec *iov, int cnt) 
+{
+  off_t length = 0;
+  int i;
+
+  for (i = 0; i < cnt; i++)
+    length += iov[i].iov_len;
+  return length;
+}
+
+/* Returns the number of whole sectors, at most MAX_CNT, that can
+   be transferred in one contiguous run between the RUN
+   consecutive disk sectors at the start of an extent's remainder
+   and the current segment of IT. */
+static size_t
+sector_run (const struct iov_iter *it, size_t run, size_t max_cnt) 
+{
+  size_t seg_cnt = iov_iter_left (it) / BLOCK_SECTOR_SIZE;
+
+  if (max_cnt > seg_cnt)
+    max_cnt = seg_cnt;
+  return run < max_cnt ? run : max_cnt;
 }
 
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
    Returns the number of bytes actually read, which may be less
    than SIZE if an error occurs or end of file is reached. */
 off_t
-inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) 
+inode_read_at (struct inode *inode, void *buffer, off_t size, off_t offset) 
+{
+  struct iovec iov;
+
+  iov.iov_base = buffer;
+  iov.iov_len = size;
+  return inode_read_iov (inode, &iov, 1, offset);
+}
+
+/* Reads from INODE, starting at position OFFSET, into the IOVCNT
+   buffers described by IOV, filling each in turn.  Returns the
+   number of bytes actually read, which may be less than the
+   total length of the buffers if an error occurs or end of file
+   is reached.
+
+   Runs of whole sectors are read straight into the buffers,
+   bypassing the buffer cache except for sectors already in it.
+   Only a sector that is partly read, at the head or tail of the
+   range, or that straddles two buffers goes through the cache
+   and a bounce buffer. */
+off_t
+inode_read_iov (struct inode *inode, const struct iovec *iov, int iovcnt,
+                off_t offset) 
 {
-  uint8_t *buffer = buffer_;
+  struct iov_iter it;
+  off_t size = iov_length (iov, iovcnt);
   off_t bytes_read = 0;
   uint8_t *bounce = NULL;
 
+  iov_iter_init (&it, iov, iovcnt);
+  rwlock_acquire_read (&inode->rw);
   while (size > 0) 
     {
-      /* Disk sector to read, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
-      int sector_ofs = offset % BLOCK_SECTOR_SIZE;
-
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
+      int sector_ofs = offset % BLOCK_SECTOR_SIZE;
       off_t inode_left = inode_length (inode) - offset;
       int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
       int min_left = inode_left < sector_left ? inode_left : sector_left;
 
       /* Number of bytes to actually copy out of this sector. */
       int chunk_size = size < min_left ? size : min_left;
+      block_sector_t sector_idx;
+      size_t run;
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
+      /* Disk sector to read. */
+      sector_idx = byte_to_sector (inode, offset, &run);
+      if (sector_idx == 0)
         {
-          /* Read full sector directly into caller's buffer. */
-          block_read (fs_device, sector_idx, buffer + bytes_read);
+          /* Not on disk: either pending or never written. */
+          const uint8_t *p = pending_lookup (inode,
+                                             offset / BLOCK_SECTOR_SIZE);
+          iov_iter_copy_out (&it, (p != NULL ? p : zeros) + sector_ofs,
+                             chunk_size);
+        }
+      else if (chunk_size == BLOCK_SECTOR_SIZE
+               && iov_iter_left (&it) >= BLOCK_SECTOR_SIZE)
+        {
+          /* Read whole sectors directly into caller's buffer,
+             in a single request where they are not cached. */
+          size_t cnt = sector_run (&it, run,
+                                   (size < inode_left ? size : inode_left)
+                                   / BLOCK_SECTOR_SIZE);
+
+          cache_read_multiple (sector_idx, cnt, iov_iter_ptr (&it));
+          iov_iter_advance (&it, cnt * BLOCK_SECTOR_SIZE);
+          chunk_size = cnt * BLOCK_SECTOR_SIZE;
         }
       else 
         {
@@ -236,8 +975,8 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
               if (bounce == NULL)
                 break;
             }
-          block_read (fs_device, sector_idx, bounce);
-          memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
+          cache_read (sector_idx, bounce);
+          iov_iter_copy_out (&it, bounce + sector_ofs, chunk_size);
         }
       
       /* Advance. */
@@ -245,6 +984,7 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       offset += chunk_size;
       bytes_read += chunk_size;
     }
+  rwlock_release_read (&inode->rw);
   free (bounce);
 
   return bytes_read;
@@ -252,40 +992,84 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
 
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
    Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
+   less than SIZE if the disk is full or an error occurs.
+   Writing past end of file extends the inode. */
 off_t
-inode_write_at (struct inode *inode, const void *buffer_, off_t size,
+inode_write_at (struct inode *inode, const void *buffer, off_t size,
                 off_t offset) 
 {
-  const uint8_t *buffer = buffer_;
+  struct iovec iov;
+
+  iov.iov_base = (void *) buffer;
+  iov.iov_len = size;
+  return inode_write_iov (inode, &iov, 1, offset);
+}
+
+/* Writes the IOVCNT buffers described by IOV, one after another,
+   into INODE, starting at OFFSET.  Returns the number of bytes
+   actually written, which may be less than the total length of
+   the buffers if the disk is full or an error occurs.  Writing
+   past end of file extends the inode, allocating sectors only
+   for the data written.  Whole sectors are written straight from
+   the buffers, as in inode_read_iov(). */
+off_t
+inode_write_iov (struct inode *inode, const struct iovec *iov, int iovcnt,
+                 off_t offset) 
+{
+  struct iov_iter it;
+  off_t size = iov_length (iov, iovcnt);
   off_t bytes_written = 0;
   uint8_t *bounce = NULL;
 
+  iov_iter_init (&it, iov, iovcnt);
+  rwlock_acquire_write (&inode->rw);
   if (inode->deny_write_cnt)
-    return 0;
+    {
+      rwlock_release_write (&inode->rw);
+      return 0;
+    }
+  inode->write_cnt++;
+  if (size > INT32_MAX - offset)
+    size = INT32_MAX - offset;
 
   while (size > 0) 
     {
-      /* Sector to write, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
+      /* Bytes left in sector, bytes to write into this sector. */
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
-
-      /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode_length (inode) - offset;
       int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
-      int min_left = inode_left < sector_left ? inode_left : sector_left;
+      int chunk_size = size < sector_left ? size : sector_left;
 
-      /* Number of bytes to actually write into this sector. */
-      int chunk_size = size < min_left ? size : min_left;
-      if (chunk_size <= 0)
-        break;
+      /* Sector to write. */
+      size_t run;
+      block_sector_t sector_idx = byte_to_sector (inode, offset, &run);
+      uint8_t *p = NULL;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
+      /* No disk sector yet: write into the pending buffer, or, if
+         no page is free for it, give the sector a disk sector. */
+      if (sector_idx == 0)
         {
-          /* Write full sector directly to disk. */
-          block_write (fs_device, sector_idx, buffer + bytes_written);
+          p = pending_sector (inode, offset / BLOCK_SECTOR_SIZE);
+          if (p == NULL)
+            {
+              sector_idx = map_sector (inode, offset / BLOCK_SECTOR_SIZE);
+              if (sector_idx == 0)
+                break;
+              run = 1;
+            }
+        }
+
+      if (p != NULL)
+        iov_iter_copy_in (&it, p + sector_ofs, chunk_size);
+      else if (chunk_size == BLOCK_SECTOR_SIZE
+               && iov_iter_left (&it) >= BLOCK_SECTOR_SIZE)
+        {
+          /* Write whole sectors directly to disk, in a single
+             request where they are not cached. */
+          size_t cnt = sector_run (&it, run, size / BLOCK_SECTOR_SIZE);
+
+          cache_write_multiple (sector_idx, cnt, iov_iter_ptr (&it));
+          iov_iter_advance (&it, cnt * BLOCK_SECTOR_SIZE);
+          chunk_size = cnt * BLOCK_SECTOR_SIZE;
         }
       else 
         {
@@ -301,11 +1085,11 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
              we're writing, then we need to read in the sector
              first.  Otherwise we start with a sector of all zeros. */
           if (sector_ofs > 0 || chunk_size < sector_left) 
-            block_read (fs_device, sector_idx, bounce);
+            cache_read (sector_idx, bounce);
           else
             memset (bounce, 0, BLOCK_SECTOR_SIZE);
-          memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-          block_write (fs_device, sector_idx, bounce);
+          iov_iter_copy_in (&it, bounce + sector_ofs, chunk_size);
+          cache_write (sector_idx, bounce);
         }
 
       /* Advance. */
@@ -313,6 +1097,12 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       offset += chunk_size;
       bytes_written += chunk_size;
     }
+  if (offset > inode->data.length)
+    {
+      inode->data.length = offset;
+      cache_write (inode->sector, &inode->data);
+    }
+  rwlock_release_write (&inode->rw);
   free (bounce);
 
   return bytes_written;
@@ -323,8 +1113,10 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 void
 inode_deny_write (struct inode *inode) 
 {
+  rwlock_acquire_write (&inode->rw);
   inode->deny_write_cnt++;
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+  rwlock_release_write (&inode->rw);
 }
 
 /* Re-enables writes to INODE.
@@ -333,9 +1125,11 @@ inode_deny_write (struct inode *inode)
 void
 inode_allow_write (struct inode *inode) 
 {
+  rwlock_acquire_write (&inode->rw);
   ASSERT (inode->deny_write_cnt > 0);
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
   inode->deny_write_cnt--;
+  rwlock_release_write (&inode->rw);
 }
 
 /* Returns the length, in bytes, of INODE's data. */
@@ -344,3 +1138,56 @@ inode_length (const struct inode *inode)
 {
   return inode->data.length;
 }
+
+/* Allocates disk sectors for, and writes out, any of INODE's
+   data whose allocation was delayed. */
+void
+inode_flush (struct inode *inode) 
+{
+  rwlock_acquire_write (&inode->rw);
+  if (inode->pend_cnt > 0)
+    flush_pending (inode);
+  rwlock_release_write (&inode->rw);
+}
+
+/* Writes out the delayed data of every open inode, so that it
+   is not lost if the inodes are never closed, as at shutdown.
+   Each inode's rw lock is taken while open_inodes_lock is held,
+   which is safe because no thread acquires open_inodes_lock
+   while it holds an inode's rw lock. */
+void
+inode_flush_all (void) 
+{
+  struct hash_iterator i;
+
+  lock_acquire (&open_inodes_lock);
+  hash_first (&i, &open_inodes);
+  while (hash_next (&i))
+    inode_flush (hash_entry (hash_cur (&i), struct inode, elem));
+  lock_release (&open_inodes_lock);
+}
+
+/* Returns the number of writes made to INODE since it was
+   opened.  Data read from INODE is still current if this has not
+   changed since before it was read. */
+unsigned
+inode_write_cnt (const struct inode *inode)
+{
+  return inode->write_cnt;
+}
+
+/* Acquires INODE's directory lock, which directory.c holds while
+   it looks up, adds or removes entries in the directory stored in
+   INODE. */
+void
+inode_lock_dir (struct inode *inode) 
+{
+  lock_acquire (&inode->dir_lock);
+}
+
+/* Releases INODE's directory lock. */
+void
+inode_unlock_dir (struct inode *inode) 
+{
+  lock_release (&inode->dir_lock);
+}
@@ -31,7 +31,11 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+
+    /* Scatter/gather I/O. */
+    SYS_READV,                  /* Read from a file into several buffers. */
+    SYS_WRITEV                  /* Write to a file from several buffers. */
   };
 
 #endif /* lib/syscall-nr.h */
@@ -123,6 +123,18 @@ write (int fd, const void *buffer, unsigned size)
   return syscall3 (SYS_WRITE, fd, buffer, size);
 }
 
+int
+readv (int fd, const struct iovec *iov, int iovcnt)
+{
+  return syscall3 (SYS_READV, fd, iov, iovcnt);
+}
+
+int
+writev (int fd, const struct iovec *iov, int iovcnt)
+{
+  return syscall3 (SYS_WRITEV, fd, iov, iovcnt);
+}
+
 void
 seek (int fd, unsigned position) 
 {
@@ -0,0 +1,75 @@
+/* Measures the cost of sleeping threads.  Runs rounds of 1, 10,
+   100, and 1000 sleepers, each of which sleeps a few times, and
+   prints the scheduler statistics (context switches and idle
+   ticks) after each round.  With a proper sleep queue, the
+   number of context switches per round grows with the number
+   of wakeups, not with the number of ticks slept.
+
+   Each sleeper needs a page for its struct thread, so with the
+   default amount of memory the larger rounds may not be able to
+   create every thread.  The test reports how many it created;
+   use "pintos -m" to give the kernel more memory. */
+
+#include <stdio.h>
+#include <inttypes.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+/* Number of times each sleeper sleeps. */
+#define ITERATIONS 5
+
+/* Number of ticks each sleeper sleeps each time. */
+#define DURATION 10
+
+static thread_func sleeper;
+static void run_round (int thread_cnt);
+
+void
+test_alarm_bench (void)
+{
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  run_round (1);
+  run_round (10);
+  run_round (100);
+  run_round (1000);
+}
+
+/* Creates THREAD_CNT sleepers, waits for all of them to finish,
+   and prints the resulting statistics. */
+static void
+run_round (int thread_cnt)
+{
+  struct semaphore done;
+  int64_t start;
+  int created;
+  int i;
+
+  sema_init (&done, 0);
+  start = timer_ticks ();
+  for (created = 0; created < thread_cnt; created++)
+    if (thread_create ("sleeper", PRI_DEFAULT, sleeper, &done) == TID_ERROR)
+      break;
+  for (i = 0; i < created; i++)
+    sema_down (&done);
+
+  msg ("%d of %d sleepers, %d sleeps of %d ticks each, %"PRId64" ticks:",
+       created, thread_cnt, ITERATIONS, DURATION, timer_elapsed (start));
+  thread_print_stats ();
+}
+
+/* Sleeper thread. */
+static void
+sleeper (void *done_)
+{
+  struct semaphore *done = done_;
+  int i;
+
+  for (i = 0; i < ITERATIONS; i++)
+    timer_sleep (DURATION);
+  sema_up (done);
+}
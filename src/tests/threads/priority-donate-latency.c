@@ -0,0 +1,157 @@
+/* Measures how long a high-priority thread waits for a lock held
+   by a low-priority thread while medium-priority threads hog the
+   CPU.  This is the pattern of a high-priority system call
+   waiting on the global file system lock behind a low-priority
+   holder.
+
+   Without priority donation the low-priority holder cannot run
+   until the hogs give up the CPU, so the tail of the wait time
+   distribution is as long as the hogs' run time.  With donation
+   every wait is bounded by the holder's critical section.
+
+   Prints the number of samples and the mean, median, 90th and
+   99th percentile, and maximum wait times in timer ticks. */
+
+#include <stdio.h>
+#include <inttypes.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+/* Number of times the high-priority thread acquires the lock. */
+#define SAMPLE_CNT 100
+
+/* Number of medium-priority CPU hogs. */
+#define HOG_CNT 4
+
+/* Ticks the low-priority holder keeps the lock each time. */
+#define HOLD_TICKS 2
+
+/* Ticks after which the hogs give up, bounding the test's run
+   time when donation is not working. */
+#define HOG_TICKS 1000
+
+struct latency_test
+  {
+    struct lock lock;                   /* The contended lock. */
+    struct semaphore done;              /* Upped by each finishing thread. */
+    volatile bool finished;             /* Set when sampling is done. */
+    int64_t hog_deadline;               /* Tick at which hogs stop. */
+    int64_t waits[SAMPLE_CNT];          /* Wait time samples, in ticks. */
+  };
+
+static thread_func low_thread;
+static thread_func hog_thread;
+static thread_func high_thread;
+static void spin_until (int64_t tick);
+static void sort_waits (int64_t *, int cnt);
+
+void
+test_priority_donate_latency (void)
+{
+  static struct latency_test test;
+  int64_t sum;
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  lock_init (&test.lock);
+  sema_init (&test.done, 0);
+  test.finished = false;
+  test.hog_deadline = timer_ticks () + HOG_TICKS;
+
+  msg ("Donation depth limit is %d.", thread_donate_depth);
+  thread_set_priority (PRI_MAX);
+  thread_create ("low", PRI_DEFAULT - 10, low_thread, &test);
+  for (i = 0; i < HOG_CNT; i++)
+    thread_create ("hog", PRI_DEFAULT, hog_thread, &test);
+  thread_create ("high", PRI_DEFAULT + 10, high_thread, &test);
+
+  /* Let the other threads run, then collect them. */
+  thread_set_priority (PRI_MIN);
+  for (i = 0; i < HOG_CNT + 2; i++)
+    sema_down (&test.done);
+
+  sort_waits (test.waits, SAMPLE_CNT);
+  sum = 0;
+  for (i = 0; i < SAMPLE_CNT; i++)
+    sum += test.waits[i];
+  msg ("%d samples: mean %"PRId64", p50 %"PRId64", p90 %"PRId64", "
+       "p99 %"PRId64", max %"PRId64" ticks.",
+       SAMPLE_CNT, sum / SAMPLE_CNT, test.waits[SAMPLE_CNT / 2],
+       test.waits[SAMPLE_CNT * 90 / 100], test.waits[SAMPLE_CNT * 99 / 100],
+       test.waits[SAMPLE_CNT - 1]);
+}
+
+/* Repeatedly holds the lock for HOLD_TICKS ticks. */
+static void
+low_thread (void *test_)
+{
+  struct latency_test *test = test_;
+
+  while (!test->finished)
+    {
+      lock_acquire (&test->lock);
+      spin_until (timer_ticks () + HOLD_TICKS);
+      lock_release (&test->lock);
+    }
+  sema_up (&test->done);
+}
+
+/* Burns CPU until sampling is done or the deadline passes. */
+static void
+hog_thread (void *test_)
+{
+  struct latency_test *test = test_;
+
+  while (!test->finished && timer_ticks () < test->hog_deadline)
+    continue;
+  sema_up (&test->done);
+}
+
+/* Acquires the lock SAMPLE_CNT times, recording each wait. */
+static void
+high_thread (void *test_)
+{
+  struct latency_test *test = test_;
+  int i;
+
+  for (i = 0; i < SAMPLE_CNT; i++)
+    {
+      int64_t start;
+
+      timer_sleep (1 + i % 3);
+      start = timer_ticks ();
+      lock_acquire (&test->lock);
+      test->waits[i] = timer_elapsed (start);
+      lock_release (&test->lock);
+    }
+  test->finished = true;
+  sema_up (&test->done);
+}
+
+/* Busy-waits until timer tick TICK. */
+static void
+spin_until (int64_t tick)
+{
+  while (timer_ticks () < tick)
+    continue;
+}
+
+/* Sorts the CNT elements of WAITS in ascending order. */
+static void
+sort_waits (int64_t *waits, int cnt)
+{
+  int i, j;
+
+  for (i = 1; i < cnt; i++)
+    {
+      int64_t w = waits[i];
+      for (j = i; j > 0 && waits[j - 1] > w; j--)
+        waits[j] = waits[j - 1];
+      waits[j] = w;
+    }
+}
@@ -0,0 +1,37 @@
+/* Child process of read-par.
+   Reads file "data<N>" from start to end the number of times
+   given by the first argument, where N is the second argument,
+   and exits with N. */
+
+#include <debug.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+
+static char buf[4096];
+
+int
+main (int argc UNUSED, char *argv[]) 
+{
+  int passes = atoi (argv[1]);
+  int id = atoi (argv[2]);
+  char name[16];
+  int handle;
+  int i;
+
+  test_name = "child-read";
+  quiet = true;
+
+  snprintf (name, sizeof name, "data%d", id);
+  CHECK ((handle = open (name)) > 1, "open \"%s\"", name);
+  for (i = 0; i < passes; i++)
+    {
+      seek (handle, 0);
+      while (read (handle, buf, sizeof buf) > 0)
+        continue;
+    }
+  close (handle);
+
+  return id;
+}
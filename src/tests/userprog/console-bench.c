@@ -0,0 +1,28 @@
+/* Measures console output throughput: writes many lines of text
+   to standard output with write(), as a chatty program would.
+   Divide the "Console" character count in the kernel's
+   statistics at power off by the elapsed ticks to get bytes per
+   second.  Not graded; run with
+   "make tests/userprog/console-bench.output". */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Number of lines to write. */
+#define LINE_CNT 2000
+
+void
+test_main (void) 
+{
+  static const char line[] =
+    "The quick brown fox jumps over the lazy dog, "
+    "then does it all again.\n";
+  int i;
+
+  for (i = 0; i < LINE_CNT; i++)
+    if (write (STDOUT_FILENO, line, strlen (line)) != (int) strlen (line))
+      fail ("write() to console failed on line %d", i);
+}
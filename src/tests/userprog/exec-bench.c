@@ -0,0 +1,30 @@
+/* Measures fork-exec throughput: executes and waits for
+   child-simple many times in a row, like exec-multiple but long
+   enough to time.  The kernel's statistics at power off give the
+   elapsed ticks and how many page allocations were served from
+   the page cache.  Not graded; run with
+   "make tests/userprog/exec-bench.output". */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Number of child processes to run. */
+#define CHILD_CNT 100
+
+void
+test_main (void) 
+{
+  int i;
+
+  for (i = 0; i < CHILD_CNT; i++)
+    {
+      pid_t pid;
+      int code;
+
+      CHECK ((pid = exec ("child-simple")) != -1, "exec child %d", i);
+      code = wait (pid);
+      if (code != 81)
+        fail ("wait(exec(\"child-simple\")) returned %d", code);
+    }
+}
@@ -0,0 +1,54 @@
+/* Measures how file read throughput scales with the number of
+   concurrent readers.  Creates one file per reader, then runs the
+   number of child-read processes given as the first command-line
+   argument, each reading its own file over and over.  The total
+   amount read is the same for any number of readers, so the
+   elapsed ticks in the kernel's statistics at power off show how
+   much the readers overlap.  Not graded; run with, e.g.,
+   "make tests/userprog/read-par-4.output" and compare
+   against read-par-1. */
+
+#include <debug.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+
+/* Maximum number of readers. */
+#define READER_MAX 8
+
+/* Size of each reader's file, in bytes. */
+#define FILE_SIZE (32 * 1024)
+
+/* Number of times a file is read in all, divided among the
+   readers. */
+#define TOTAL_PASSES 64
+
+int
+main (int argc UNUSED, char *argv[]) 
+{
+  pid_t pids[READER_MAX];
+  char cmd[64];
+  int reader_cnt = atoi (argv[1]);
+  int i;
+
+  test_name = "read-par";
+
+  if (reader_cnt < 1 || reader_cnt > READER_MAX)
+    fail ("reader count must be between 1 and %d", READER_MAX);
+
+  for (i = 0; i < reader_cnt; i++)
+    {
+      char name[16];
+
+      snprintf (name, sizeof name, "data%d", i);
+      CHECK (create (name, FILE_SIZE), "create \"%s\"", name);
+    }
+
+  msg ("%d readers, %d passes each over %d bytes",
+       reader_cnt, TOTAL_PASSES / reader_cnt, FILE_SIZE);
+  snprintf (cmd, sizeof cmd, "child-read %d", TOTAL_PASSES / reader_cnt);
+  exec_children (cmd, pids, reader_cnt);
+  wait_children (pids, reader_cnt);
+  return 0;
+}
@@ -0,0 +1,46 @@
+/* Measures sequential read throughput: writes a large file, then
+   reads it back from start to end in page-sized pieces, checking
+   each piece, as "cat" or the loader would.  Compare the elapsed
+   ticks and the read requests in the kernel's statistics at
+   power off.  Not graded; run with
+   "make tests/userprog/read-seq.output". */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Size of the file, in bytes. */
+#define FILE_SIZE (512 * 1024)
+
+static char buf[4096];
+
+void
+test_main (void) 
+{
+  size_t ofs;
+  int handle;
+  size_t i;
+
+  CHECK (create ("seq", FILE_SIZE), "create \"seq\"");
+  CHECK ((handle = open ("seq")) > 1, "open \"seq\"");
+  for (ofs = 0; ofs < FILE_SIZE; ofs += sizeof buf)
+    {
+      for (i = 0; i < sizeof buf; i++)
+        buf[i] = (ofs + i) % 251;
+      if (write (handle, buf, sizeof buf) != (int) sizeof buf)
+        fail ("write() at offset %zu failed", ofs);
+    }
+  close (handle);
+
+  CHECK ((handle = open ("seq")) > 1, "open \"seq\"");
+  msg ("read \"seq\"");
+  for (ofs = 0; ofs < FILE_SIZE; ofs += sizeof buf)
+    {
+      if (read (handle, buf, sizeof buf) != (int) sizeof buf)
+        fail ("read() at offset %zu failed", ofs);
+      for (i = 0; i < sizeof buf; i++)
+        if (buf[i] != (char) ((ofs + i) % 251))
+          fail ("byte %zu differs", ofs + i);
+    }
+  close (handle);
+}
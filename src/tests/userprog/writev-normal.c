@@ -0,0 +1,40 @@
+/* Writes a file spanning several sectors with writev(), using
+   buffers that do not line up with sector boundaries, then reads
+   it back with read(). */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* File size.  More than four sectors, not a multiple of one. */
+#define FILE_SIZE 2124
+
+static char buf[FILE_SIZE];
+
+void
+test_main (void) 
+{
+  struct iovec iov[3];
+  int handle, byte_cnt;
+  size_t i;
+
+  for (i = 0; i < sizeof buf; i++)
+    buf[i] = i % 251;
+
+  CHECK (create ("test.txt", sizeof buf), "create \"test.txt\"");
+  CHECK ((handle = open ("test.txt")) > 1, "open \"test.txt\"");
+
+  iov[0].iov_base = buf;
+  iov[0].iov_len = 100;
+  iov[1].iov_base = buf + 100;
+  iov[1].iov_len = 1024;
+  iov[2].iov_base = buf + 1124;
+  iov[2].iov_len = sizeof buf - 1124;
+  byte_cnt = writev (handle, iov, 3);
+  if (byte_cnt != sizeof buf)
+    fail ("writev() returned %d instead of %zu", byte_cnt, sizeof buf);
+  msg ("close \"test.txt\"");
+  close (handle);
+
+  check_file ("test.txt", buf, sizeof buf);
+}
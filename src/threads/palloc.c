@@ -8,6 +8,7 @@
 #include <stdio.h>
 #include <string.h>
 #include "threads/loader.h"
+#include "threads/interrupt.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
 
@@ -23,7 +24,17 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Each pool also keeps a small cache of pages that are allocated
+   in its bitmap but already zeroed and unused.  The idle thread
+   refills the caches with palloc_refill(), so that single-page
+   allocations, such as a new thread's struct thread, a process's
+   page directory, or its command line copy, usually skip both
+   the bitmap scan and the memset. */
+
+/* Number of pre-zeroed pages cached per pool. */
+#define PAGE_CACHE_SIZE 8
 
 /* A memory pool. */
 struct pool
@@ -31,14 +42,27 @@ struct pool
     struct lock lock;                   /* Mutual exclusion. */
     struct bitmap *used_map;            /* Bitmap of free pages. */
     uint8_t *base;                      /* Base of pool. */
+
+    /* Pre-zeroed page cache.  Accessed only with interrupts
+       off, so that the idle thread can refill it without
+       sleeping. */
+    void *cache[PAGE_CACHE_SIZE];       /* Cached pages. */
+    size_t cache_cnt;                   /* Number of cached pages. */
   };
 
+/* Statistics. */
+static long long cache_hits;    /* # of pages allocated from a cache. */
+static long long cache_misses;  /* # of single pages taken from a bitmap. */
+
 /* Two pools: one for kernel data, one for user pages. */
 static struct pool kernel_pool, user_pool;
 
 static void init_pool (struct pool *, void *base, size_t page_cnt,
                        const char *name);
 static bool page_from_pool (const struct pool *, void *page);
+static void *cache_pop (struct pool *);
+static bool cache_drain (struct pool *);
+static void cache_refill (struct pool *);
 
 /* Initializes the page allocator.  At most USER_PAGE_LIMIT
    pages are put into the user pool. */
@@ -66,7 +90,10 @@ palloc_init (size_t user_page_limit)
    otherwise from the kernel pool.  If PAL_ZERO is set in FLAGS,
    then the pages are filled with zeros.  If too few pages are
    available, returns a null pointer, unless PAL_ASSERT is set in
-   FLAGS, in which case the kernel panics. */
+   FLAGS, in which case the kernel panics.
+
+   A single page is taken from the pool's cache of pre-zeroed
+   pages if possible. */
 void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
 {
@@ -77,8 +104,18 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
   if (page_cnt == 0)
     return NULL;
 
+  if (page_cnt == 1)
+    {
+      pages = cache_pop (pool);
+      if (pages != NULL)
+        return pages;
+      cache_misses++;
+    }
+
   lock_acquire (&pool->lock);
   page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
+  if (page_idx == BITMAP_ERROR && cache_drain (pool))
+    page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
   lock_release (&pool->lock);
 
   if (page_idx != BITMAP_ERROR)
@@ -148,6 +185,105 @@ palloc_free_page (void *page)
   palloc_free_multiple (page, 1);
 }
 
+/* Refills the pre-zeroed page caches of both pools.  Never
+   sleeps: if a pool is busy, its cache is left alone.  Called
+   by the idle thread. */
+void
+palloc_refill (void) 
+{
+  cache_refill (&kernel_pool);
+  cache_refill (&user_pool);
+}
+
+/* Prints page allocator statistics. */
+void
+palloc_print_stats (void) 
+{
+  printf ("Palloc: %lld pages from cache, %lld single pages from bitmap\n",
+          cache_hits, cache_misses);
+}
+
+/* Removes and returns a page from POOL's cache, or a null
+   pointer if the cache is empty. */
+static void *
+cache_pop (struct pool *pool) 
+{
+  enum intr_level old_level;
+  void *page = NULL;
+
+  old_level = intr_disable ();
+  if (pool->cache_cnt > 0)
+    {
+      page = pool->cache[--pool->cache_cnt];
+      cache_hits++;
+    }
+  intr_set_level (old_level);
+
+  return page;
+}
+
+/* Returns the pages in POOL's cache to its bitmap, so that a
+   multi-page allocation can use them.  POOL's lock must be held.
+   Returns true if any pages were returned. */
+static bool
+cache_drain (struct pool *pool) 
+{
+  enum intr_level old_level;
+  bool drained = false;
+
+  ASSERT (lock_held_by_current_thread (&pool->lock));
+
+  old_level = intr_disable ();
+  while (pool->cache_cnt > 0)
+    {
+      void *page = pool->cache[--pool->cache_cnt];
+      bitmap_reset (pool->used_map, pg_no (page) - pg_no (pool->base));
+      drained = true;
+    }
+  intr_set_level (old_level);
+
+  return drained;
+}
+
+/* Fills POOL's cache with zeroed pages, stopping early if the
+   pool's lock is held by another thread or the pool is out of
+   free pages. */
+static void
+cache_refill (struct pool *pool) 
+{
+  while (pool->cache_cnt < PAGE_CACHE_SIZE) 
+    {
+      enum intr_level old_level;
+      size_t page_idx;
+      void *page;
+
+      if (!lock_try_acquire (&pool->lock))
+        return;
+      page_idx = bitmap_scan_and_flip (pool->used_map, 0, 1, false);
+      lock_release (&pool->lock);
+      if (page_idx == BITMAP_ERROR)
+        return;
+
+      page = pool->base + PGSIZE * page_idx;
+      memset (page, 0, PGSIZE);
+
+      old_level = intr_disable ();
+      if (pool->cache_cnt < PAGE_CACHE_SIZE)
+        {
+          pool->cache[pool->cache_cnt++] = page;
+          page = NULL;
+        }
+      intr_set_level (old_level);
+
+      /* Someone else filled the cache meanwhile. */
+      if (page != NULL)
+        {
+          palloc_free_page (page);
+          return;
+        }
+    }
+}
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void
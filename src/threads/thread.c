@@ -11,6 +11,7 @@
 #include "threads/switch.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
+#include "devices/timer.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #endif
@@ -20,17 +21,41 @@
    of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
+/* Number of distinct thread priorities. */
+#define PRI_CNT (PRI_MAX - PRI_MIN + 1)
+
+/* Run queue.  Processes in THREAD_READY state, that is,
+   processes that are ready to run but not actually running, are
+   kept in ready_lists[] in FIFO order, one list per priority.
+   Bit P of ready_mask is set if and only if ready_lists[P] is
+   nonempty, so the highest-priority ready thread is found with
+   a single bit scan. */
+static struct list ready_lists[PRI_CNT];
+static uint64_t ready_mask;
+static int ready_cnt;           /* Number of threads in ready_lists[]. */
 
 /* List of all processes.  Processes are added to this list
    when they are first scheduled and removed when they exit. */
-struct list all_list;
+static struct list all_list;
+
+/* Index of all_list by tid, for thread_apply().  Created by
+   thread_start(), once malloc() works; protected by tid_lock. */
+static struct hash tid_table;
 
 /* Idle thread. */
 static struct thread *idle_thread;
 
+/* Threads that have died but whose pages have not been freed
+   yet.  thread_schedule_tail() queues dying threads here instead
+   of freeing them during the context switch, and thread_reap()
+   frees them in batches, normally from the idle thread. */
+static struct list reap_list;
+static unsigned reap_cnt;       /* Number of threads in reap_list. */
+
+/* If this many dead threads are waiting, thread_create() reaps
+   them itself instead of waiting for the system to go idle. */
+#define REAP_BACKLOG 16
+
 /* Initial thread, the thread running init.c:main(). */
 static struct thread *initial_thread;
 
@@ -49,16 +74,72 @@ struct kernel_thread_frame
 static long long idle_ticks;    /* # of timer ticks spent idle. */
 static long long kernel_ticks;  /* # of timer ticks in kernel threads. */
 static long long user_ticks;    /* # of timer ticks in user programs. */
+static long long switch_cnt;    /* # of context switches. */
+
+/* The threads that used the most CPU time among those that have
+   exited, in descending order of run_ticks, so that
+   thread_print_stats() can report them at shutdown. */
+#define EXITED_TOP_CNT 8
+struct exited_thread
+  {
+    tid_t tid;                          /* Thread identifier. */
+    char name[16];                      /* Name. */
+    struct thread_stats stats;          /* Final statistics. */
+  };
+static struct exited_thread exited_top[EXITED_TOP_CNT];
+static int exited_top_cnt;
+
+/* Scheduler trace: a ring buffer of the most recent context
+   switches.  It has a single writer, thread_schedule_tail(),
+   which runs with interrupts off, so entries are recorded
+   without locking.  sched_trace_head counts every switch ever
+   recorded; the entry for switch N is at N % SCHED_TRACE_SIZE. */
+#define SCHED_TRACE_SIZE 64     /* Must be a power of 2. */
+struct sched_event
+  {
+    int64_t tick;                       /* Timer tick of the switch. */
+    tid_t prev;                         /* Thread switched away from. */
+    tid_t next;                         /* Thread switched to. */
+    enum thread_status prev_status;     /* Why PREV stopped running. */
+  };
+static struct sched_event sched_trace[SCHED_TRACE_SIZE];
+static unsigned sched_trace_head;
+
+/* Names of thread states, for printing statistics. */
+static const char *thread_status_names[] = 
+  {"running", "ready", "blocked", "dying"};
+
+/* If true, thread_print_stats() also dumps the scheduler trace.
+   Controlled by kernel command-line option "-sched-trace". */
+bool thread_trace_dump;
+
+/* Set by thread_preempt() so that schedule() counts the switch
+   as involuntary. */
+static bool preempting;
 
 /* Scheduling. */
 #define TIME_SLICE 4            /* # of timer ticks to give each thread. */
 static unsigned thread_ticks;   /* # of timer ticks since last yield. */
 
+/* Multi-level feedback queue scheduler state. */
+#define MLFQS_PRI_TICKS 4       /* # of timer ticks between priority updates. */
+static fixed_point load_avg;    /* System load average. */
+
+/* Threads whose recent_cpu has changed since priorities were last
+   recomputed.  Only these need a new priority every
+   MLFQS_PRI_TICKS ticks; between the once-per-second updates,
+   no other thread's inputs change. */
+static struct list cpu_changed_list;
+
 /* If false (default), use round-robin scheduler.
    If true, use multi-level feedback queue scheduler.
    Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 
+/* Maximum length of a priority donation chain.
+   Controlled by kernel command-line option "-donate-depth=N". */
+int thread_donate_depth = 8;
+
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED);
@@ -70,6 +151,18 @@ static void *alloc_frame (struct thread *, size_t size);
 static void schedule (void);
 void thread_schedule_tail (struct thread *prev);
 static tid_t allocate_tid (void);
+static void ready_push (struct thread *);
+static void set_status (struct thread *, enum thread_status);
+static void record_exit_stats (struct thread *);
+static void yield_cpu (void);
+static hash_hash_func tid_hash;
+static hash_less_func tid_less;
+static void ready_remove (struct thread *);
+static void mlfqs_tick (struct thread *);
+static int mlfqs_priority (const struct thread *);
+static void mlfqs_update_priority (struct thread *);
+static thread_action_func mlfqs_update_recent_cpu;
+static int ready_max_priority (void);
 
 /* Initializes the threading system by transforming the code
    that's currently running into a thread.  This can't work in
@@ -87,11 +180,18 @@ static tid_t allocate_tid (void);
 void
 thread_init (void) 
 {
+  int i;
+
   ASSERT (intr_get_level () == INTR_OFF);
 
   lock_init (&tid_lock);
-  list_init (&ready_list);
+  for (i = 0; i < PRI_CNT; i++)
+    list_init (&ready_lists[i]);
+  ready_mask = 0;
   list_init (&all_list);
+  list_init (&cpu_changed_list);
+  list_init (&reap_list);
+  load_avg = fp_from_int (0);
 
   /* Set up a thread structure for the running thread. */
   initial_thread = running_thread ();
@@ -105,6 +205,11 @@ thread_init (void)
 void
 thread_start (void) 
 {
+  /* Index the running thread by tid. */
+  if (!hash_init (&tid_table, tid_hash, tid_less, NULL))
+    PANIC ("could not create tid table");
+  hash_insert (&tid_table, &initial_thread->tidelem);
+
   /* Create the idle thread. */
   struct semaphore idle_started;
   sema_init (&idle_started, 0);
@@ -125,6 +230,7 @@ thread_tick (void)
   struct thread *t = thread_current ();
 
   /* Update statistics. */
+  t->stats.run_ticks++;
   if (t == idle_thread)
     idle_ticks++;
 #ifdef USERPROG
@@ -134,17 +240,76 @@ thread_tick (void)
   else
     kernel_ticks++;
 
+  if (thread_mlfqs)
+    mlfqs_tick (t);
+
   /* Enforce preemption. */
   if (++thread_ticks >= TIME_SLICE)
     intr_yield_on_return ();
 }
 
-/* Prints thread statistics. */
+/* Prints one line of statistics for thread TID named NAME. */
+static void
+print_thread_stats (tid_t tid, const char *name,
+                    const struct thread_stats *st, const char *state) 
+{
+  printf ("  %4d %-16s %8lld %8lld %8lld %7u %7u %s\n",
+          tid, name, st->run_ticks, st->ready_ticks, st->blocked_ticks,
+          st->vol_switches, st->invol_switches, state);
+}
+
+/* Prints thread statistics: the global totals, then per-thread
+   counters for every live thread and for the exited threads
+   that used the most CPU time. */
 void
 thread_print_stats (void) 
 {
-  printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
-          idle_ticks, kernel_ticks, user_ticks);
+  enum intr_level old_level;
+  struct list_elem *e;
+  int i;
+
+  printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks, "
+          "%lld context switches\n",
+          idle_ticks, kernel_ticks, user_ticks, switch_cnt);
+
+  printf ("  %4s %-16s %8s %8s %8s %7s %7s %s\n", "tid", "name",
+          "run", "ready", "blocked", "vol", "invol", "state");
+  old_level = intr_disable ();
+  for (e = list_begin (&all_list); e != list_end (&all_list);
+       e = list_next (e))
+    {
+      struct thread *t = list_entry (e, struct thread, allelem);
+      print_thread_stats (t->tid, t->name, &t->stats,
+                          thread_status_names[t->status]);
+    }
+  for (i = 0; i < exited_top_cnt; i++)
+    print_thread_stats (exited_top[i].tid, exited_top[i].name,
+                        &exited_top[i].stats, "exited");
+  intr_set_level (old_level);
+
+  if (thread_trace_dump)
+    thread_print_trace ();
+}
+
+/* Prints the scheduler trace, oldest switch first. */
+void
+thread_print_trace (void) 
+{
+  enum intr_level old_level;
+  unsigned head, i;
+
+  old_level = intr_disable ();
+  head = sched_trace_head;
+  printf ("Scheduler trace: last %u of %u switches\n",
+          head < SCHED_TRACE_SIZE ? head : SCHED_TRACE_SIZE, head);
+  for (i = head < SCHED_TRACE_SIZE ? 0 : head - SCHED_TRACE_SIZE;
+       i != head; i++)
+    {
+      const struct sched_event *ev = &sched_trace[i % SCHED_TRACE_SIZE];
+      printf ("  tick %8lld: %4d -> %4d (%s)\n",
+              ev->tick, ev->prev, ev->next, thread_status_names[ev->prev_status]);
+    }
+  intr_set_level (old_level);
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -159,9 +324,8 @@ thread_print_stats (void)
    scheduled.  Use a semaphore or some other form of
    synchronization if you need to ensure ordering.
 
-   The code provided sets the new thread's `priority' member to
-   PRIORITY, but no actual priority scheduling is implemented.
-   Priority scheduling is the goal of Problem 1-3. */
+   If the new thread has a higher priority than the running
+   thread, the running thread yields to it immediately. */
 tid_t
 thread_create (const char *name, int priority,
                thread_func *function, void *aux) 
@@ -174,14 +338,25 @@ thread_create (const char *name, int priority,
 
   ASSERT (function != NULL);
 
-  /* Allocate thread. */
+  /* Allocate thread, reaping dead threads first if many are
+     waiting or if memory is short. */
+  if (reap_cnt >= REAP_BACKLOG)
+    thread_reap ();
   t = palloc_get_page (PAL_ZERO);
   if (t == NULL)
-    return TID_ERROR;
+    {
+      thread_reap ();
+      t = palloc_get_page (PAL_ZERO);
+      if (t == NULL)
+        return TID_ERROR;
+    }
 
   /* Initialize thread. */
   init_thread (t, name, priority);
   tid = t->tid = allocate_tid ();
+  lock_acquire (&tid_lock);
+  hash_insert (&tid_table, &t->tidelem);
+  lock_release (&tid_lock);
 
   /* Stack frame for kernel_thread(). */
   kf = alloc_frame (t, sizeof *kf);
@@ -200,6 +375,7 @@ thread_create (const char *name, int priority,
 
   /* Add to run queue. */
   thread_unblock (t);
+  thread_check_preempt ();
 
   return tid;
 }
@@ -216,7 +392,7 @@ thread_block (void)
   ASSERT (!intr_context ());
   ASSERT (intr_get_level () == INTR_OFF);
 
-  thread_current ()->status = THREAD_BLOCKED;
+  set_status (thread_current (), THREAD_BLOCKED);
   schedule ();
 }
 
@@ -237,8 +413,8 @@ thread_unblock (struct thread *t)
 
   old_level = intr_disable ();
   ASSERT (t->status == THREAD_BLOCKED);
-  list_push_back (&ready_list, &t->elem);
-  t->status = THREAD_READY;
+  ready_push (t);
+  set_status (t, THREAD_READY);
   intr_set_level (old_level);
 }
 
@@ -286,13 +462,20 @@ thread_exit (void)
   process_exit ();
 #endif
 
+  lock_acquire (&tid_lock);
+  hash_delete (&tid_table, &thread_current ()->tidelem);
+  lock_release (&tid_lock);
+
   /* Remove thread from all threads list, set our status to dying,
      and schedule another process.  That process will destroy us
      when it calls thread_schedule_tail(). */
   // printf("%s: exit(%d)\n",thread_name(), thread_current()->exit_status);
   intr_disable ();
   list_remove (&thread_current()->allelem);
-  thread_current ()->status = THREAD_DYING;
+  if (thread_current ()->cpu_changed)
+    list_remove (&thread_current ()->cpuelem);
+  record_exit_stats (thread_current ());
+  set_status (thread_current (), THREAD_DYING);
   schedule ();
   NOT_REACHED ();
 }
@@ -302,19 +485,94 @@ thread_exit (void)
 void
 thread_yield (void) 
 {
-  struct thread *cur = thread_current ();
+  ASSERT (!intr_context ());
+
+  yield_cpu ();
+}
+
+/* Yields the CPU because the current thread was preempted, by
+   the end of its time slice or by a higher-priority thread.
+   Same as thread_yield(), except that a resulting switch is
+   counted as involuntary. */
+void
+thread_preempt (void) 
+{
   enum intr_level old_level;
-  
+
   ASSERT (!intr_context ());
 
+  old_level = intr_disable ();
+  preempting = true;
+  yield_cpu ();
+  intr_set_level (old_level);
+}
+
+/* Puts the current thread on the run queue and schedules. */
+static void
+yield_cpu (void) 
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
   old_level = intr_disable ();
   if (cur != idle_thread) 
-    list_push_back (&ready_list, &cur->elem);
-  cur->status = THREAD_READY;
+    ready_push (cur);
+  set_status (cur, THREAD_READY);
   schedule ();
   intr_set_level (old_level);
 }
 
+/* Yields the CPU if a ready thread has a higher priority than
+   the running thread.  Within an interrupt handler, the yield
+   is deferred until the handler returns. */
+void
+thread_check_preempt (void) 
+{
+  enum intr_level old_level = intr_disable ();
+  bool preempt = ready_max_priority () > thread_current ()->priority;
+  intr_set_level (old_level);
+
+  if (preempt)
+    {
+      if (intr_context ())
+        intr_yield_on_return ();
+      else
+        thread_preempt ();
+    }
+}
+
+/* Frees the pages, and the page directories of user processes,
+   of all threads that have died since the last call.  Must not
+   be called from an interrupt handler.
+
+   The queue is detached with interrupts off, then freed with
+   interrupts on, so that the work does not delay interrupts or
+   context switches.  Never sleeps, so it is safe to call from
+   the idle thread. */
+void
+thread_reap (void) 
+{
+  struct list dead;
+  enum intr_level old_level;
+
+  ASSERT (!intr_context ());
+
+  list_init (&dead);
+  old_level = intr_disable ();
+  if (!list_empty (&reap_list))
+    list_splice (list_end (&dead), list_begin (&reap_list),
+                 list_end (&reap_list));
+  reap_cnt = 0;
+  intr_set_level (old_level);
+
+  while (!list_empty (&dead))
+    {
+      struct thread *t = list_entry (list_pop_front (&dead),
+                                     struct thread, elem);
+      palloc_free_page (t);
+    }
+}
+
 /* Invoke function 'func' on all threads, passing along 'aux'.
    This function must be called with interrupts off. */
 void
@@ -332,11 +590,99 @@ thread_foreach (thread_action_func *func, void *aux)
     }
 }
 
-/* Sets the current thread's priority to NEW_PRIORITY. */
+/* Invokes FUNC on the live thread whose tid is TID, passing
+   along AUX, and returns true, or returns false if there is no
+   such thread.  FUNC runs with tid_lock held, which keeps the
+   thread from exiting and being freed, so it must not block. */
+bool
+thread_apply (tid_t tid, thread_action_func *func, void *aux) 
+{
+  struct thread key;
+  struct hash_elem *e;
+
+  key.tid = tid;
+  lock_acquire (&tid_lock);
+  e = hash_find (&tid_table, &key.tidelem);
+  if (e != NULL)
+    func (hash_entry (e, struct thread, tidelem), aux);
+  lock_release (&tid_lock);
+
+  return e != NULL;
+}
+
+/* Sets the current thread's base priority to NEW_PRIORITY,
+   yielding if the thread no longer has the highest priority.
+   A priority donated to the thread stays in effect until the
+   donating lock is released. */
 void
 thread_set_priority (int new_priority) 
 {
-  thread_current ()->priority = new_priority;
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (PRI_MIN <= new_priority && new_priority <= PRI_MAX);
+
+  /* The MLFQS computes priorities itself. */
+  if (thread_mlfqs)
+    return;
+
+  old_level = intr_disable ();
+  cur->base_priority = new_priority;
+  thread_refresh_priority (cur);
+  intr_set_level (old_level);
+
+  thread_check_preempt ();
+}
+
+/* Sets thread T's effective priority to PRIORITY, moving T to
+   the matching run queue if it is ready.  Does not preempt the
+   running thread.  Interrupts must be off. */
+void
+thread_change_priority (struct thread *t, int priority) 
+{
+  ASSERT (is_thread (t));
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
+
+  if (t->priority == priority)
+    return;
+
+  if (t->status == THREAD_READY && t != idle_thread)
+    {
+      ready_remove (t);
+      t->priority = priority;
+      ready_push (t);
+    }
+  else
+    t->priority = priority;
+}
+
+/* Recomputes thread T's effective priority as the maximum of its
+   base priority and the priorities of the threads waiting for
+   locks that T holds.  Interrupts must be off. */
+void
+thread_refresh_priority (struct thread *t) 
+{
+  int priority = t->base_priority;
+  struct list_elem *l, *w;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (l = list_begin (&t->held_locks); l != list_end (&t->held_locks);
+       l = list_next (l))
+    {
+      struct lock *lock = list_entry (l, struct lock, elem);
+      struct list *waiters = &lock->semaphore.waiters;
+
+      for (w = list_begin (waiters); w != list_end (waiters);
+           w = list_next (w))
+        {
+          struct thread *waiter = list_entry (w, struct thread, elem);
+          if (waiter->priority > priority)
+            priority = waiter->priority;
+        }
+    }
+  thread_change_priority (t, priority);
 }
 
 /* Returns the current thread's priority. */
@@ -346,35 +692,152 @@ thread_get_priority (void)
   return thread_current ()->priority;
 }
 
-/* Sets the current thread's nice value to NICE. */
+/* Sets the current thread's nice value to NICE, recomputes its
+   priority, and yields if it no longer has the highest
+   priority. */
 void
-thread_set_nice (int nice UNUSED) 
+thread_set_nice (int nice) 
 {
-  /* Not yet implemented. */
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (NICE_MIN <= nice && nice <= NICE_MAX);
+
+  old_level = intr_disable ();
+  cur->nice = nice;
+  if (thread_mlfqs)
+    mlfqs_update_priority (cur);
+  intr_set_level (old_level);
+
+  thread_check_preempt ();
 }
 
 /* Returns the current thread's nice value. */
 int
 thread_get_nice (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  return thread_current ()->nice;
 }
 
 /* Returns 100 times the system load average. */
 int
 thread_get_load_avg (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int load_avg_100 = fp_to_int_nearest (fp_mul_int (load_avg, 100));
+  intr_set_level (old_level);
+
+  return load_avg_100;
 }
 
 /* Returns 100 times the current thread's recent_cpu value. */
 int
 thread_get_recent_cpu (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int recent_cpu_100
+    = fp_to_int_nearest (fp_mul_int (thread_current ()->recent_cpu, 100));
+  intr_set_level (old_level);
+
+  return recent_cpu_100;
+}
+
+/* Does the MLFQS bookkeeping for timer tick, with T running.
+   Called from thread_tick() in an external interrupt context.
+
+   Every tick charges T one tick of recent_cpu.  Every
+   MLFQS_PRI_TICKS ticks, the priorities of the threads charged
+   since the last update are recomputed.  Every second, the load
+   average and every thread's recent_cpu and priority are
+   recomputed. */
+static void
+mlfqs_tick (struct thread *t) 
+{
+  int64_t ticks = timer_ticks ();
+
+  if (t != idle_thread)
+    {
+      t->recent_cpu = fp_add_int (t->recent_cpu, 1);
+      if (!t->cpu_changed)
+        {
+          t->cpu_changed = true;
+          list_push_back (&cpu_changed_list, &t->cpuelem);
+        }
+    }
+
+  if (ticks % TIMER_FREQ == 0)
+    {
+      int ready_threads = ready_cnt + (t != idle_thread ? 1 : 0);
+      fixed_point coef;
+
+      load_avg = fp_add (fp_div_int (fp_mul_int (load_avg, 59), 60),
+                         fp_div_int (fp_from_int (ready_threads), 60));
+      coef = fp_div (fp_mul_int (load_avg, 2),
+                     fp_add_int (fp_mul_int (load_avg, 2), 1));
+      thread_foreach (mlfqs_update_recent_cpu, &coef);
+
+      /* Every priority was just recomputed. */
+      while (!list_empty (&cpu_changed_list))
+        list_entry (list_pop_front (&cpu_changed_list), struct thread,
+                    cpuelem)->cpu_changed = false;
+    }
+  else if (ticks % MLFQS_PRI_TICKS == 0)
+    {
+      while (!list_empty (&cpu_changed_list))
+        {
+          struct thread *c = list_entry (list_pop_front (&cpu_changed_list),
+                                         struct thread, cpuelem);
+          c->cpu_changed = false;
+          mlfqs_update_priority (c);
+        }
+    }
+  else
+    return;
+
+  thread_check_preempt ();
+}
+
+/* Decays thread T's recent_cpu by the coefficient *COEF_ and
+   recomputes its priority.  Used with thread_foreach(). */
+static void
+mlfqs_update_recent_cpu (struct thread *t, void *coef_) 
+{
+  const fixed_point *coef = coef_;
+
+  if (t == idle_thread)
+    return;
+  t->recent_cpu = fp_add_int (fp_mul (*coef, t->recent_cpu), t->nice);
+  mlfqs_update_priority (t);
+}
+
+/* Returns the MLFQS priority for thread T, computed from its
+   recent_cpu and nice values. */
+static int
+mlfqs_priority (const struct thread *t) 
+{
+  int priority = PRI_MAX - fp_to_int_zero (fp_div_int (t->recent_cpu, 4))
+                 - t->nice * 2;
+
+  if (priority < PRI_MIN)
+    return PRI_MIN;
+  else if (priority > PRI_MAX)
+    return PRI_MAX;
+  else
+    return priority;
+}
+
+/* Recomputes thread T's MLFQS priority, moving T within the run
+   queue if it is ready.  Interrupts must be off. */
+static void
+mlfqs_update_priority (struct thread *t) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (t == idle_thread)
+    return;
+
+  t->base_priority = mlfqs_priority (t);
+  thread_change_priority (t, t->base_priority);
 }
 
 /* Idle thread.  Executes when no other thread is ready to run.
@@ -385,7 +848,11 @@ thread_get_recent_cpu (void)
    to it to enable thread_start() to continue, and immediately
    blocks.  After that, the idle thread never appears in the
    ready list.  It is returned by next_thread_to_run() as a
-   special case when the ready list is empty. */
+   special case when the ready list is empty.
+
+   Each time it runs, the idle thread also frees the threads that
+   have died since it last ran and refills the page allocator's
+   caches of zeroed pages. */
 static void
 idle (void *idle_started_ UNUSED) 
 {
@@ -395,6 +862,10 @@ idle (void *idle_started_ UNUSED)
 
   for (;;) 
     {
+      /* Free dead threads, then restock the page caches. */
+      thread_reap ();
+      palloc_refill ();
+
       /* Let someone else run. */
       intr_disable ();
       thread_block ();
@@ -460,17 +931,25 @@ init_thread (struct thread *t, const char *name, int priority)
 
   memset (t, 0, sizeof *t);
   t->status = THREAD_BLOCKED;
+  t->status_tick = timer_ticks ();
   strlcpy (t->name, name, sizeof t->name);
   t->stack = (uint8_t *) t + PGSIZE;
-  t->priority = priority;
+  t->priority = t->base_priority = priority;
+  list_init (&t->held_locks);
   t->magic = THREAD_MAGIC;
 
+  /* Under the MLFQS, a new thread inherits its parent's nice and
+     recent_cpu values, and its priority follows from them. */
+  if (t != running_thread ())
+    {
+      t->nice = running_thread ()->nice;
+      t->recent_cpu = running_thread ()->recent_cpu;
+    }
+  if (thread_mlfqs)
+    t->priority = t->base_priority = mlfqs_priority (t);
+
 #ifdef USERPROG
-  t->ptid = running_thread()->tid;
-  t->seen_status = 0;
-  sema_init(&t->parent_sema, 0);
-  sema_init(&t->exit_sema, 0);
-  sema_init(&t->load_sema, 0);
+  list_init (&t->children);
 #endif
 
   old_level = intr_disable ();
@@ -491,22 +970,81 @@ alloc_frame (struct thread *t, size_t size)
   return t->stack;
 }
 
+/* Adds T to the back of the run queue for its priority.
+   Interrupts must be off. */
+static void
+ready_push (struct thread *t) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (PRI_MIN <= t->priority && t->priority <= PRI_MAX);
+
+  list_push_back (&ready_lists[t->priority - PRI_MIN], &t->elem);
+  ready_mask |= (uint64_t) 1 << (t->priority - PRI_MIN);
+  ready_cnt++;
+}
+
+/* Removes ready thread T from the run queue.  Interrupts must be
+   off. */
+static void
+ready_remove (struct thread *t) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (t->status == THREAD_READY);
+
+  list_remove (&t->elem);
+  if (list_empty (&ready_lists[t->priority - PRI_MIN]))
+    ready_mask &= ~((uint64_t) 1 << (t->priority - PRI_MIN));
+  ready_cnt--;
+}
+
+/* Returns the priority of the highest-priority ready thread, or
+   PRI_MIN - 1 if the run queue is empty.  Interrupts must be
+   off. */
+static int
+ready_max_priority (void) 
+{
+  uint32_t hi = ready_mask >> 32;
+  uint32_t lo = ready_mask;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (hi != 0)
+    return PRI_MIN + 32 + (31 - __builtin_clz (hi));
+  else if (lo != 0)
+    return PRI_MIN + (31 - __builtin_clz (lo));
+  else
+    return PRI_MIN - 1;
+}
+
 /* Chooses and returns the next thread to be scheduled.  Should
    return a thread from the run queue, unless the run queue is
    empty.  (If the running thread can continue running, then it
    will be in the run queue.)  If the run queue is empty, return
-   idle_thread. */
+   idle_thread.
+
+   Among ready threads, the one with the highest priority is
+   chosen; threads of equal priority run in round-robin order. */
 static struct thread *
 next_thread_to_run (void) 
 {
-  if (list_empty (&ready_list))
+  int priority = ready_max_priority ();
+  struct list *list;
+  struct thread *t;
+
+  if (priority < PRI_MIN)
     return idle_thread;
-  else
-    return list_entry (list_pop_front (&ready_list), struct thread, elem);
+
+  list = &ready_lists[priority - PRI_MIN];
+  t = list_entry (list_pop_front (list), struct thread, elem);
+  if (list_empty (list))
+    ready_mask &= ~((uint64_t) 1 << (priority - PRI_MIN));
+  ready_cnt--;
+  return t;
 }
 
 /* Completes a thread switch by activating the new thread's page
-   tables, and, if the previous thread is dying, destroying it.
+   tables, and, if the previous thread is dying, queuing it to be
+   destroyed by thread_reap().
 
    At this function's invocation, we just switched from thread
    PREV, the new thread is already running, and interrupts are
@@ -529,7 +1067,18 @@ thread_schedule_tail (struct thread *prev)
   ASSERT (intr_get_level () == INTR_OFF);
 
   /* Mark us as running. */
-  cur->status = THREAD_RUNNING;
+  set_status (cur, THREAD_RUNNING);
+
+  /* Record the switch in the scheduler trace. */
+  if (prev != NULL)
+    {
+      struct sched_event *ev
+        = &sched_trace[sched_trace_head++ % SCHED_TRACE_SIZE];
+      ev->tick = cur->status_tick;
+      ev->prev = prev->tid;
+      ev->next = cur->tid;
+      ev->prev_status = prev->status;
+    }
 
   /* Start new time slice. */
   thread_ticks = 0;
@@ -539,15 +1088,18 @@ thread_schedule_tail (struct thread *prev)
   process_activate ();
 #endif
 
-  /* If the thread we switched from is dying, destroy its struct
-     thread.  This must happen late so that thread_exit() doesn't
-     pull out the rug under itself.  (We don't free
+  /* If the thread we switched from is dying, queue its struct
+     thread for destruction.  This must happen late so that
+     thread_exit() doesn't pull out the rug under itself.  The
+     page is freed later by thread_reap(), keeping the cost of
+     freeing off the context switch path.  (We don't free
      initial_thread because its memory was not obtained via
      palloc().) */
   if (prev != NULL && prev->status == THREAD_DYING && prev != initial_thread) 
     {
       ASSERT (prev != cur);
-      palloc_free_page (prev);
+      list_push_back (&reap_list, &prev->elem);
+      reap_cnt++;
     }
 }
 
@@ -570,10 +1122,58 @@ schedule (void)
   ASSERT (is_thread (next));
 
   if (cur != next)
-    prev = switch_threads (cur, next);
+    {
+      switch_cnt++;
+      if (preempting)
+        cur->stats.invol_switches++;
+      else
+        cur->stats.vol_switches++;
+      prev = switch_threads (cur, next);
+    }
+  preempting = false;
   thread_schedule_tail (prev);
 }
 
+/* Sets thread T's status to STATUS, charging the time spent in
+   its previous status to T's statistics.  Time spent running is
+   charged tick by tick in thread_tick() instead. */
+static void
+set_status (struct thread *t, enum thread_status status) 
+{
+  int64_t now = timer_ticks ();
+
+  if (t->status == THREAD_READY)
+    t->stats.ready_ticks += now - t->status_tick;
+  else if (t->status == THREAD_BLOCKED)
+    t->stats.blocked_ticks += now - t->status_tick;
+  t->status = status;
+  t->status_tick = now;
+}
+
+/* Adds exiting thread T to exited_top[] if it is among the
+   heaviest CPU users seen so far.  Interrupts must be off. */
+static void
+record_exit_stats (struct thread *t) 
+{
+  int i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (i = exited_top_cnt; i > 0; i--)
+    if (exited_top[i - 1].stats.run_ticks >= t->stats.run_ticks)
+      break;
+  if (i >= EXITED_TOP_CNT)
+    return;
+
+  if (exited_top_cnt < EXITED_TOP_CNT)
+    exited_top_cnt++;
+  memmove (&exited_top[i + 1], &exited_top[i],
+           (exited_top_cnt - i - 1) * sizeof *exited_top);
+  exited_top[i].tid = t->tid;
+  strlcpy (exited_top[i].name, t->name, sizeof exited_top[i].name);
+  exited_top[i].stats = t->stats;
+}
+
 /* Returns a tid to use for a new thread. */
 static tid_t
 allocate_tid (void) 
@@ -592,18 +1192,21 @@ allocate_tid (void)
    Used by switch.S, which can't figure it out on its own. */
 uint32_t thread_stack_ofs = offsetof (struct thread, stack);
 
-struct thread *
-thread_wait(tid_t child_tid)
+/* Returns a hash value for thread T's tid. */
+static unsigned
+tid_hash (const struct hash_elem *t_, void *aux UNUSED) 
 {
-  struct list_elem *e;
-
-  for (e = list_begin (&all_list); e != list_end (&all_list);
-      e = list_next (e))
-  {
-    struct thread *t = list_entry (e, struct thread, allelem);
-    if (t->ptid == thread_tid () && t->tid == child_tid)
-      return t;
-  }
+  const struct thread *t = hash_entry (t_, struct thread, tidelem);
+  return hash_int (t->tid);
+}
 
-  return NULL;
+/* Returns true if thread A's tid is less than thread B's. */
+static bool
+tid_less (const struct hash_elem *a_, const struct hash_elem *b_,
+          void *aux UNUSED) 
+{
+  const struct thread *a = hash_entry (a_, struct thread, tidelem);
+  const struct thread *b = hash_entry (b_, struct thread, tidelem);
+  return a->tid < b->tid;
 }
+
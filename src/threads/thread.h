@@ -2,8 +2,10 @@
 #define THREADS_THREAD_H
 
 #include <debug.h>
+#include <hash.h>
 #include <list.h>
 #include <stdint.h>
+#include "threads/fixed-point.h"
 #include "threads/synch.h"
 
 /* States in a thread's life cycle. */
@@ -25,6 +27,24 @@ typedef int tid_t;
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
 
+/* Number of signals a user process can handle. */
+#define SIGNAL_CNT 3
+
+/* Thread niceness, for the MLFQS. */
+#define NICE_MIN -20                    /* Nicest. */
+#define NICE_DEFAULT 0                  /* Default niceness. */
+#define NICE_MAX 20                     /* Least nice. */
+
+/* Scheduling statistics kept for each thread. */
+struct thread_stats
+  {
+    int64_t run_ticks;                  /* Timer ticks spent running. */
+    int64_t ready_ticks;                /* Timer ticks spent ready to run. */
+    int64_t blocked_ticks;              /* Timer ticks spent blocked. */
+    unsigned vol_switches;              /* Switches away by blocking/yielding. */
+    unsigned invol_switches;            /* Switches away by preemption. */
+  };
+
 /* A kernel thread or user process.
 
    Each thread structure is stored in its own 4 kB page.  The
@@ -75,12 +95,14 @@ typedef int tid_t;
    the `magic' member of the running thread's `struct thread' is
    set to THREAD_MAGIC.  Stack overflow will normally change this
    value, triggering the assertion. */
-/* The `elem' member has a dual purpose.  It can be an element in
-   the run queue (thread.c), or it can be an element in a
-   semaphore wait list (synch.c).  It can be used these two ways
-   only because they are mutually exclusive: only a thread in the
-   ready state is on the run queue, whereas only a thread in the
-   blocked state is on a semaphore wait list. */
+/* The `elem' member has a triple purpose.  It can be an element
+   in the run queue (thread.c), an element in a semaphore wait
+   list (synch.c), or an element in the sleep queue (timer.c).
+   It can be used these ways only because they are mutually
+   exclusive: only a thread in the ready state is on the run
+   queue, whereas only a thread in the blocked state is on a
+   semaphore wait list or the sleep queue, and a blocked thread
+   waits for exactly one event. */
 struct thread
   {
     /* Owned by thread.c. */
@@ -88,28 +110,40 @@ struct thread
     enum thread_status status;          /* Thread state. */
     char name[16];                      /* Name (for debugging purposes). */
     uint8_t *stack;                     /* Saved stack pointer. */
-    int priority;                       /* Priority. */
+    int priority;                       /* Effective priority. */
+    int base_priority;                  /* Priority before donation. */
     struct list_elem allelem;           /* List element for all threads list. */
+    struct hash_elem tidelem;           /* Element in tid index. */
+    struct thread_stats stats;          /* Scheduling statistics. */
+    int64_t status_tick;                /* Tick of last status change. */
 
-    /* Shared between thread.c and synch.c. */
+    /* Shared between thread.c, synch.c and timer.c. */
     struct list_elem elem;              /* List element. */
 
+    /* Shared between thread.c and synch.c. */
+    struct lock *waiting_lock;          /* Lock being waited for, if any. */
+    struct list held_locks;             /* Locks held, for donation. */
+
+    /* Owned by thread.c, for the MLFQS. */
+    int nice;                           /* Niceness. */
+    fixed_point recent_cpu;             /* Recent CPU time received. */
+    bool cpu_changed;                   /* On cpu_changed_list? */
+    struct list_elem cpuelem;           /* cpu_changed_list element. */
+
+    /* Owned by devices/timer.c. */
+    int64_t wakeup_tick;                /* Tick to wake up at, if sleeping. */
+
 #ifdef USERPROG
     /* Owned by userprog/process.c. */
     uint32_t *pagedir;                  /* Page directory. */
-    uint32_t fd[128];
-    uint32_t fd_pos;
-    struct file* fd_file[128]; // Maintain one to many pid_t to fd coupled with fd_file
+    struct file **files;                /* Open files, indexed by fd. */
+    int file_slots;                     /* Number of elements in files. */
+    int file_free;                      /* No free fd is lower than this. */
     struct file* itself;
-    tid_t ptid;
-    tid_t ctid;
-    int exit_status;
-    int seen_status;
-    struct semaphore parent_sema;
-    struct semaphore exit_sema;
-    struct semaphore load_sema;
-    int load_status;
-    void (*handler[3]) (); /* Signal Handler */
+    struct dir *cwd;                    /* Working directory, or NULL. */
+    struct process_record *record;      /* Own exit record, or NULL. */
+    struct list children;               /* Children's exit records. */
+    void (*handler[SIGNAL_CNT]) (void); /* Signal Handler */
 #endif
 
     /* Owned by thread.c. */
@@ -121,11 +155,21 @@ struct thread
    Controlled by kernel command-line option "-o mlfqs". */
 extern bool thread_mlfqs;
 
+/* Maximum number of lock holders a priority donation is passed
+   through.  Controlled by kernel command-line option
+   "-donate-depth=N". */
+extern int thread_donate_depth;
+
+/* If true, thread_print_stats() also dumps the scheduler trace.
+   Controlled by kernel command-line option "-sched-trace". */
+extern bool thread_trace_dump;
+
 void thread_init (void);
 void thread_start (void);
 
 void thread_tick (void);
 void thread_print_stats (void);
+void thread_print_trace (void);
 
 typedef void thread_func (void *aux);
 tid_t thread_create (const char *name, int priority, thread_func *, void *);
@@ -138,20 +182,24 @@ tid_t thread_tid (void);
 const char *thread_name (void);
 
 void thread_exit (void) NO_RETURN;
+void thread_reap (void);
 void thread_yield (void);
+void thread_preempt (void);
+void thread_check_preempt (void);
 
 /* Performs some operation on thread t, given auxiliary data AUX. */
 typedef void thread_action_func (struct thread *t, void *aux);
 void thread_foreach (thread_action_func *, void *);
+bool thread_apply (tid_t, thread_action_func *, void *);
 
 int thread_get_priority (void);
 void thread_set_priority (int);
+void thread_change_priority (struct thread *, int);
+void thread_refresh_priority (struct thread *);
 
 int thread_get_nice (void);
 void thread_set_nice (int);
 int thread_get_recent_cpu (void);
 int thread_get_load_avg (void);
 
-struct thread *thread_wait(tid_t child_tid);
-
 #endif /* threads/thread.h */
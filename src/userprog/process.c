@@ -16,26 +16,43 @@
 #include "threads/flags.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/thread.h"
 #include "userprog/syscall.h"
 #include "threads/vaddr.h"
 
-extern struct lock filesys_lock;
 static thread_func start_process NO_RETURN;
 static bool load (const char *cmdline, void (**eip) (void), void **esp);
+static void release_record (struct process_record *);
+
+/* Lowest file descriptor handed out for a file.  0 and 1 are the
+   console. */
+#define FD_MIN 2
+
+/* Number of slots in a process's first file table. */
+#define FD_INIT_SLOTS 16
+
+/* Passed from process_execute() to start_process(). */
+struct exec_info
+  {
+    char *file_name;                    /* Command line, in a page. */
+    struct process_record *record;      /* New process's exit record. */
+    struct dir *cwd;                    /* New process's working directory. */
+  };
 
 /* Starts a new thread running a user program loaded from
-   FILENAME.  The new thread may be scheduled (and may even exit)
-   before process_execute() returns.  Returns the new process's
-   thread id, or TID_ERROR if the thread cannot be created. */
+   FILENAME, and waits for it to finish loading.  The new thread
+   may even exit before process_execute() returns.  Returns the
+   new process's thread id, or TID_ERROR if the thread cannot be
+   created or the program cannot be loaded. */
 tid_t
 process_execute (const char *file_name) 
 {
   char *fn_copy, *exe_name, *save_ptr;
   tid_t tid;
-  struct file *file = NULL;
-  enum intr_level old_level;
+  struct exec_info info;
+  struct process_record *rec;
 
   char s[strlen(file_name) + 1]; 
   strlcpy(s, file_name, strlen(file_name) + 1);
@@ -48,23 +65,72 @@ process_execute (const char *file_name)
     return TID_ERROR;
   strlcpy (fn_copy, file_name, PGSIZE);
 
+  /* The record starts out referenced by both us and the child. */
+  rec = malloc (sizeof *rec);
+  if (rec == NULL)
+    {
+      palloc_free_page (fn_copy);
+      return TID_ERROR;
+    }
+  rec->exit_status = -1;
+  rec->loaded = false;
+  sema_init (&rec->load_sema, 0);
+  sema_init (&rec->exit_sema, 0);
+  rec->ref_cnt = 2;
+
+  /* The child starts out in our working directory. */
+  info.cwd = NULL;
+  if (thread_current ()->cwd != NULL)
+    {
+      info.cwd = dir_reopen (thread_current ()->cwd);
+      if (info.cwd == NULL)
+        {
+          palloc_free_page (fn_copy);
+          free (rec);
+          return TID_ERROR;
+        }
+    }
+
   /* Create a new thread to execute FILE_NAME. */
-  tid = thread_create (exe_name, PRI_DEFAULT, start_process, fn_copy);
+  info.file_name = fn_copy;
+  info.record = rec;
+  tid = thread_create (exe_name, PRI_DEFAULT, start_process, &info);
   if (tid == TID_ERROR)
-    palloc_free_page (fn_copy); 
-  thread_current()->ctid = tid;
+    {
+      palloc_free_page (fn_copy); 
+      free (rec);
+      dir_close (info.cwd);
+      return TID_ERROR;
+    }
+  rec->tid = tid;
+  list_push_back (&thread_current ()->children, &rec->elem);
+
+  sema_down (&rec->load_sema);
+  if (!rec->loaded)
+    {
+      list_remove (&rec->elem);
+      release_record (rec);
+      return TID_ERROR;
+    }
   return tid;
 }
 
 /* A thread function that loads a user process and starts it
    running. */
 static void
-start_process (void *file_name_)
+start_process (void *info_)
 {
-  char *file_name = file_name_;
+  struct exec_info *info = info_;
+  char *file_name = info->file_name;
+  struct process_record *rec = info->record;
   struct intr_frame if_;
   bool success;
 
+  /* INFO lives on our parent's stack, which only lasts until we
+     up load_sema below. */
+  thread_current ()->record = rec;
+  thread_current ()->cwd = info->cwd;
+
   /* Initialize interrupt frame and load executable. */
   memset (&if_, 0, sizeof if_);
   if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
@@ -72,8 +138,8 @@ start_process (void *file_name_)
   if_.eflags = FLAG_IF | FLAG_MBS;
   success = load (file_name, &if_.eip, &if_.esp);
 
-  sema_up(&thread_current()->load_sema);
-  thread_current()->load_status = success;
+  rec->loaded = success;
+  sema_up (&rec->load_sema);
 
   // hex_dump(if_.esp, if_.esp, PHYS_BASE - if_.esp, true);
 
@@ -99,28 +165,57 @@ start_process (void *file_name_)
    been successfully called for the given TID, returns -1
    immediately, without waiting.
 
-   This function will be implemented in problem 2-2.  For now, it
-   does nothing. */
+   The child's status is kept in its process_record, so a child
+   that exits before it is waited for does not stay around. */
 int
 process_wait (tid_t child_tid) 
 {
-  //int i;
-  //for(i = 0; i < 1000000000; i++);
-  struct thread *t = thread_wait(child_tid); 
+  struct process_record *rec = process_find_child (child_tid);
   int exit_status;
-  if (t && !t->seen_status) 
-  {
-    // printf("PTID : %d, CTID : %d\n",thread_current()->tid, child_tid);
-    sema_down(&t->parent_sema);
-    exit_status = t->exit_status;
-    t->seen_status = 1;
-    sema_up(&t->exit_sema);
-    return exit_status;
-  }
-  else {
-    // printf("PTID : %d, CTID : %d Thread Not Found!\n");
+
+  if (rec == NULL)
     return -1;
-  }
+
+  sema_down (&rec->exit_sema);
+  exit_status = rec->exit_status;
+  list_remove (&rec->elem);
+  release_record (rec);
+  return exit_status;
+}
+
+/* Returns the exit record of the running process's child whose
+   tid is CHILD_TID, or a null pointer if there is no such child
+   or it has already been waited for. */
+struct process_record *
+process_find_child (tid_t child_tid)
+{
+  struct list *children = &thread_current ()->children;
+  struct list_elem *e;
+
+  for (e = list_begin (children); e != list_end (children);
+       e = list_next (e))
+    {
+      struct process_record *rec = list_entry (e, struct process_record,
+                                               elem);
+      if (rec->tid == child_tid)
+        return rec;
+    }
+  return NULL;
+}
+
+/* Drops one reference to REC, freeing it if that was the last. */
+static void
+release_record (struct process_record *rec)
+{
+  enum intr_level old_level;
+  int ref_cnt;
+
+  old_level = intr_disable ();
+  ref_cnt = --rec->ref_cnt;
+  intr_set_level (old_level);
+
+  if (ref_cnt == 0)
+    free (rec);
 }
 
 /* Free the current process's resources. */
@@ -131,7 +226,10 @@ process_exit (void)
   uint32_t *pd;
 
   /* Destroy the current process's page directory and switch back
-     to the kernel-only page directory. */
+     to the kernel-only page directory.  This is done now, rather
+     than when the thread's page is reaped, so that the process's
+     user pages are free again by the time our parent learns that
+     we have exited. */
   pd = cur->pagedir;
   if (pd != NULL) 
     {
@@ -139,15 +237,98 @@ process_exit (void)
          cur->pagedir to NULL before switching page directories,
          so that a timer interrupt can't switch back to the
          process page directory.  We must activate the base page
-         directory before destroying the process's page
-         directory, or our active page directory will be one
+         directory before the process's page directory can be
+         destroyed, or our active page directory will be one
          that's been freed (and cleared). */
       cur->pagedir = NULL;
       pagedir_activate (NULL);
       pagedir_destroy (pd);
     }
-    sema_up(&cur->parent_sema);
-    sema_down(&cur->exit_sema);
+
+  /* Report our exit status to our parent, if any, and let go of
+     our children's records.  Neither waits for anyone. */
+  if (cur->record != NULL)
+    {
+      sema_up (&cur->record->exit_sema);
+      release_record (cur->record);
+      cur->record = NULL;
+    }
+  while (!list_empty (&cur->children))
+    release_record (list_entry (list_pop_front (&cur->children),
+                                struct process_record, elem));
+
+  /* The files themselves were closed by our exit system call. */
+  free (cur->files);
+  cur->files = NULL;
+  cur->file_slots = 0;
+
+  dir_close (cur->cwd);
+  cur->cwd = NULL;
+}
+
+/* Adds FILE to the running process's file table and returns its
+   new file descriptor, the lowest one not in use, or -1 if the
+   table cannot be grown. */
+int
+process_add_file (struct file *file) 
+{
+  struct thread *cur = thread_current ();
+  int fd;
+
+  ASSERT (file != NULL);
+
+  for (fd = cur->file_free > FD_MIN ? cur->file_free : FD_MIN;
+       fd < cur->file_slots; fd++)
+    if (cur->files[fd] == NULL)
+      break;
+
+  /* Grow the table by doubling it. */
+  if (fd >= cur->file_slots) 
+    {
+      int slots = cur->file_slots > 0 ? cur->file_slots * 2 : FD_INIT_SLOTS;
+      struct file **files = realloc (cur->files, slots * sizeof *files);
+      if (files == NULL)
+        return -1;
+      memset (files + cur->file_slots, 0,
+              (slots - cur->file_slots) * sizeof *files);
+      fd = cur->file_slots > FD_MIN ? cur->file_slots : FD_MIN;
+      cur->files = files;
+      cur->file_slots = slots;
+    }
+
+  cur->files[fd] = file;
+  cur->file_free = fd + 1;
+  return fd;
+}
+
+/* Returns the file that the running process has open as FD, or a
+   null pointer if FD is not open. */
+struct file *
+process_get_file (int fd) 
+{
+  struct thread *cur = thread_current ();
+
+  if (fd < FD_MIN || fd >= cur->file_slots)
+    return NULL;
+  return cur->files[fd];
+}
+
+/* Removes FD from the running process's file table and returns
+   the file it referred to, which the caller must close, or a null
+   pointer if FD is not open. */
+struct file *
+process_remove_file (int fd) 
+{
+  struct thread *cur = thread_current ();
+  struct file *file = process_get_file (fd);
+
+  if (file != NULL)
+    {
+      cur->files[fd] = NULL;
+      if (fd < cur->file_free)
+        cur->file_free = fd;
+    }
+  return file;
 }
 
 /* Sets up the CPU for running user code in the current
@@ -261,7 +442,6 @@ load (const char *file_name, void (**eip) (void), void **esp)
   process_activate ();
 
   /* Open executable file. */
-  lock_acquire(&filesys_lock);
   file = filesys_open (exe_name);
   if (file == NULL) 
     {
@@ -359,7 +539,6 @@ load (const char *file_name, void (**eip) (void), void **esp)
  done:
   /* We arrive here whether the load is successful or not. */
   file_close (file);
-  lock_release(&filesys_lock);
   return success;
 }
 
@@ -1,11 +1,36 @@
 #ifndef USERPROG_PROCESS_H
 #define USERPROG_PROCESS_H
 
+#include <list.h>
+#include "threads/synch.h"
 #include "threads/thread.h"
 
+struct file;
+
+/* What a parent needs to know about a child process, kept apart
+   from the child's struct thread so that the child can be freed
+   as soon as it exits.  Shared by the parent, which finds it on
+   its `children' list, and the child, which points to it from
+   its `record' member; whichever lets go last frees it. */
+struct process_record
+  {
+    tid_t tid;                          /* Child's thread identifier. */
+    int exit_status;                    /* Status passed to exit(). */
+    bool loaded;                        /* Did the executable load? */
+    struct semaphore load_sema;         /* Upped when loading is done. */
+    struct semaphore exit_sema;         /* Upped when the child exits. */
+    int ref_cnt;                        /* References: parent, child. */
+    struct list_elem elem;              /* Element in parent's children. */
+  };
+
 tid_t process_execute (const char *file_name);
 int process_wait (tid_t);
 void process_exit (void);
 void process_activate (void);
+struct process_record *process_find_child (tid_t);
+
+int process_add_file (struct file *);
+struct file *process_get_file (int fd);
+struct file *process_remove_file (int fd);
 
 #endif /* userprog/process.h */
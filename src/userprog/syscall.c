@@ -1,7 +1,11 @@
 #include "userprog/syscall.h"
+#include <inttypes.h>
+#include <iovec.h>
+#include <limits.h>
 #include <stdio.h>
 #include <string.h>
 #include <syscall-nr.h>
+#include "devices/timer.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
@@ -10,381 +14,560 @@
 #include "userprog/process.h"
 #include "threads/synch.h"
 #include "threads/palloc.h"
+#include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/inode.h"
 #include "filesys/filesys.h"
-
+#include "devices/input.h"
+#include "userprog/uaccess.h"
 
 static void syscall_handler (struct intr_frame *);
-static bool check_address(void * address);
-static bool check_filename_address(void * address);
-
-struct lock filesys_lock;
-extern struct list all_list;
+static char *copy_in_string (const char *ustr);
+static void check_buffer (const void *ubuf, unsigned size, bool write);
+static struct file *get_plain_file (int fd);
 
-// static uint32_t file_descriptor_remain = 2; // 0, 1, and 2 might be occupied.
-static uint32_t allocate_fd(void); // used to allocate file descriptor
 int32_t __exit(int);
 
-static bool bad_ptr(void*, struct intr_frame *);
+/* A system call handler.  ARGS holds the call's arguments, copied
+   in from the user stack.  The return value goes in %eax. */
+typedef uint32_t syscall_func (const uint32_t args[]);
+
+static syscall_func sys_halt, sys_exit, sys_exec, sys_wait;
+static syscall_func sys_create, sys_remove, sys_open, sys_filesize;
+static syscall_func sys_read, sys_write, sys_seek, sys_tell, sys_close;
+static syscall_func sys_sigaction, sys_sendsig, sys_yield;
+static syscall_func sys_readv, sys_writev;
+static syscall_func sys_chdir, sys_mkdir, sys_readdir, sys_isdir, sys_inumber;
+
+/* Maximum number of arguments to a system call. */
+#define SYSCALL_MAX_ARGS 3
+
+/* System call table entry. */
+struct syscall 
+  {
+    syscall_func *func;         /* Handler, or null if unimplemented. */
+    int arg_cnt;                /* Number of 32-bit arguments. */
+    const char *name;           /* Name, for statistics. */
+  };
+
+/* System calls, indexed by SYS_* number. */
+static const struct syscall syscall_table[] = 
+  {
+    [SYS_HALT] = {sys_halt, 0, "halt"},
+    [SYS_EXIT] = {sys_exit, 1, "exit"},
+    [SYS_EXEC] = {sys_exec, 1, "exec"},
+    [SYS_WAIT] = {sys_wait, 1, "wait"},
+    [SYS_CREATE] = {sys_create, 2, "create"},
+    [SYS_REMOVE] = {sys_remove, 1, "remove"},
+    [SYS_OPEN] = {sys_open, 1, "open"},
+    [SYS_FILESIZE] = {sys_filesize, 1, "filesize"},
+    [SYS_READ] = {sys_read, 3, "read"},
+    [SYS_WRITE] = {sys_write, 3, "write"},
+    [SYS_SEEK] = {sys_seek, 2, "seek"},
+    [SYS_TELL] = {sys_tell, 1, "tell"},
+    [SYS_CLOSE] = {sys_close, 1, "close"},
+    [SYS_SIGACTION] = {sys_sigaction, 2, "sigaction"},
+    [SYS_SENDSIG] = {sys_sendsig, 2, "sendsig"},
+    [SYS_YIELD] = {sys_yield, 0, "yield"},
+    [SYS_CHDIR] = {sys_chdir, 1, "chdir"},
+    [SYS_MKDIR] = {sys_mkdir, 1, "mkdir"},
+    [SYS_READDIR] = {sys_readdir, 2, "readdir"},
+    [SYS_ISDIR] = {sys_isdir, 1, "isdir"},
+    [SYS_INUMBER] = {sys_inumber, 1, "inumber"},
+    [SYS_READV] = {sys_readv, 3, "readv"},
+    [SYS_WRITEV] = {sys_writev, 3, "writev"},
+  };
+
+/* Number of entries in syscall_table. */
+#define SYSCALL_CNT (sizeof syscall_table / sizeof *syscall_table)
+
+/* Per-system call statistics.  Time spent blocked inside a call,
+   e.g. in wait, counts toward it.  exit and halt do not return,
+   so they are never counted. */
+struct syscall_stats 
+  {
+    unsigned long long cnt;     /* Number of calls. */
+    int64_t ticks;              /* Timer ticks spent in calls. */
+    uint64_t cycles;            /* CPU cycles spent in calls. */
+  };
+
+static struct syscall_stats syscall_stats[SYSCALL_CNT];
+
+/* Returns the CPU's time-stamp counter. */
+static inline uint64_t
+rdtsc (void) 
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
 
 void
 syscall_init (void) 
 {
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
-
-  lock_init(&filesys_lock);
-  list_init(&all_list);
 }
 
-static void
-syscall_handler (struct intr_frame *f)                         
-{                                                              
-  unsigned int *status, *fd;                                            
-  char** file;                                                 
-  unsigned *initial_size, *size, *position;                    
-  void** buffer;                                               
-  void* usp = f->esp;                                          
-  struct file* f_temp;                                         
-  unsigned int i;                                                       
-  struct thread *t, *cur = thread_current ();                      
-  uint32_t *signum;
-  void (**handler) ();
-  int32_t *child_tid;
-                                                               
-  if(bad_ptr(usp,f)) return;                                   
-                                                               
-  uint32_t syscall_num = *((uint32_t*)usp);                    
-  //printf("System Call Number : %d\n",syscall_num);           
-  switch (syscall_num)                                         
-  {                                                            
-  case SYS_HALT: // (void)                                     
-    shutdown_power_off();                                      
-    break;                                                     
-  case SYS_EXIT: // (int status)                               
-    if(bad_ptr(usp + 4, f)) break;                             
-                                                               
-    status = usp + 4;                                          
-    __exit(*status);                                             
-    f->eax = *status; // NEVER REACHED                         
-    break;                                                     
-  case SYS_FILESIZE: // (int fd)                               
-    if(bad_ptr(usp + 4, f)) break;                          
-    lock_acquire(&filesys_lock);
-    fd = usp + 4;                                              
-    for(i = 0; i < cur->fd_pos; i++)                           
-    {                                                          
-      if(cur->fd[i] == *fd)                                    
-      {                                                        
-        f_temp = cur->fd_file[i];                              
-        f->eax = file_length(f_temp);                          
-      }                                                        
-    }                                                          
-    lock_release(&filesys_lock);
-    break;                                                     
-  case SYS_CREATE: // (const char* file, unsigned initial_size)
-    if(bad_ptr(usp + 16, f)) break;                            
-    if(bad_ptr(usp + 20, f)) break;                            
-	
-    file = usp + 16;                                
-    initial_size = usp + 20;                        
-                                                
-    if(!check_filename_address(*file))                       
-    {                                               
-      f->eax = -1;                                  
-      __exit(-1);                                     
-    }                                               
-    else 
-    {                                        
-      //printf("filename : %s, size :%d\n",*file,*initial_size);
-      lock_acquire(&filesys_lock);
-      f->eax = filesys_create(*file, *initial_size);
-      lock_release(&filesys_lock);
-    }      
-    break;                                          
-  case SYS_OPEN:
-    if (bad_ptr(usp + 4, f)) break;
-
-    file = usp + 4;
-
-    if(!check_filename_address(*file))
+/* Prints system call statistics, one line for each system call
+   that was made. */
+void
+syscall_print_stats (void) 
+{
+  size_t i;
+
+  for (i = 0; i < SYSCALL_CNT; i++) 
     {
-      f->eax = -1;
-      __exit(-1);
+      const struct syscall_stats *s = &syscall_stats[i];
+      if (s->cnt > 0)
+        printf ("Syscall %s: %llu calls, %"PRId64" ticks, "
+                "%"PRIu64" cycles (%"PRIu64" per call)\n",
+                syscall_table[i].name, s->cnt, s->ticks,
+                s->cycles, s->cycles / s->cnt);
     }
-    else
+}
+
+/* Copies in the system call number and arguments from the user
+   stack, then dispatches to the handler through syscall_table.
+   Kills the process if the stack cannot be read or the system
+   call is unknown. */
+static void
+syscall_handler (struct intr_frame *f) 
+{
+  const uint32_t *usp = f->esp;
+  uint32_t nr, args[SYSCALL_MAX_ARGS];
+  const struct syscall *sc;
+  struct syscall_stats *s;
+  int64_t start_ticks;
+  uint64_t start_cycles;
+  enum intr_level old_level;
+
+  if (!copy_from_user (&nr, usp, sizeof nr)
+      || nr >= SYSCALL_CNT || syscall_table[nr].func == NULL)
+    __exit(-1);
+  sc = &syscall_table[nr];
+  if (!copy_from_user (args, usp + 1, sc->arg_cnt * sizeof *args))
+    __exit(-1);
+
+  start_ticks = timer_ticks ();
+  start_cycles = rdtsc ();
+  f->eax = sc->func (args);
+
+  s = &syscall_stats[nr];
+  old_level = intr_disable ();
+  s->cnt++;
+  s->cycles += rdtsc () - start_cycles;
+  s->ticks += timer_elapsed (start_ticks);
+  intr_set_level (old_level);
+}
+
+/* halt (void) */
+static uint32_t
+sys_halt (const uint32_t args[] UNUSED) 
+{
+  shutdown_power_off ();
+}
+
+/* exit (int status) */
+static uint32_t
+sys_exit (const uint32_t args[]) 
+{
+  __exit (args[0]);
+  NOT_REACHED ();
+}
+
+/* exec (const char *cmd_line) */
+static uint32_t
+sys_exec (const uint32_t args[]) 
+{
+  char *cmd_line = copy_in_string ((const char *) args[0]);
+  tid_t tid = cmd_line != NULL ? process_execute (cmd_line) : TID_ERROR;
+
+  palloc_free_page (cmd_line);
+  return tid;
+}
+
+/* wait (pid_t pid) */
+static uint32_t
+sys_wait (const uint32_t args[]) 
+{
+  return process_wait (args[0]);
+}
+
+/* create (const char *file, unsigned initial_size) */
+static uint32_t
+sys_create (const uint32_t args[]) 
+{
+  char *file = copy_in_string ((const char *) args[0]);
+  bool success = file != NULL && filesys_create (file, args[1]);
+
+  palloc_free_page (file);
+  return success;
+}
+
+/* remove (const char *file) */
+static uint32_t
+sys_remove (const uint32_t args[]) 
+{
+  char *file = copy_in_string ((const char *) args[0]);
+  bool success = file != NULL && filesys_remove (file);
+
+  palloc_free_page (file);
+  return success;
+}
+
+/* open (const char *file) */
+static uint32_t
+sys_open (const uint32_t args[]) 
+{
+  char *name = copy_in_string ((const char *) args[0]);
+  struct file *file = name != NULL ? filesys_open (name) : NULL;
+  int fd = -1;
+
+  palloc_free_page (name);
+  if (file != NULL)
     {
-      //printf("filename : %s\n",*file);
-      lock_acquire(&filesys_lock);
-      f_temp = filesys_open(*file); 
-      if(f_temp == NULL)
-        f->eax = -1;
-      else
-      {
-        f->eax = allocate_fd();
-        cur->fd[cur->fd_pos] = f->eax;
-        cur->fd_file[cur->fd_pos] = f_temp;
-        cur->fd_pos += 1;
-      }
-      lock_release(&filesys_lock);
+      fd = process_add_file (file);
+      if (fd == -1)
+        file_close (file);
     }
-    break;
-  case SYS_CLOSE: // (int fd)
-    if(bad_ptr(usp + 4, f)) break;
+  return fd;
+}
+
+/* filesize (int fd) */
+static uint32_t
+sys_filesize (const uint32_t args[]) 
+{
+  struct file *file = process_get_file (args[0]);
 
-    lock_acquire(&filesys_lock);
-    fd = usp + 4;
+  return file != NULL ? file_length (file) : -1;
+}
 
-    for(i = 0; i < cur->fd_pos; i++)
+/* read (int fd, void *buffer, unsigned size) */
+static uint32_t
+sys_read (const uint32_t args[]) 
+{
+  int fd = args[0];
+  uint8_t *buffer = (uint8_t *) args[1];
+  unsigned size = args[2];
+  struct file *file;
+
+  check_buffer (buffer, size, true);
+  if (fd == STDIN_FILENO)
     {
-      if(cur->fd[i] == *fd)
-      {
-        file_close(cur->fd_file[i]);
-        cur->fd_pos -= 1;
-        cur->fd[i] = cur->fd[cur->fd_pos];
-        cur->fd_file[i] = cur->fd_file[cur->fd_pos];
-      }
+      unsigned i;
+
+      for (i = 0; i < size; i++)
+        buffer[i] = input_getc ();
+      return size;
     }
-    lock_release(&filesys_lock);
-    break;
-  case SYS_WRITE: // (int fd, const void* buffer, unsigned size)
-    if(bad_ptr(usp + 20, f)) break;
-    if(bad_ptr(usp + 24, f)) break;
-    if(bad_ptr(usp + 28, f)) break;
-
-    fd = usp + 20;
-    buffer = usp + 24;
-    size = usp + 28;
-
-    if(!check_address(*buffer))
+  file = get_plain_file (fd);
+  return file != NULL ? file_read (file, buffer, size) : -1;
+}
+
+/* write (int fd, const void *buffer, unsigned size) */
+static uint32_t
+sys_write (const uint32_t args[]) 
+{
+  int fd = args[0];
+  const void *buffer = (const void *) args[1];
+  unsigned size = args[2];
+  struct file *file;
+
+  check_buffer (buffer, size, false);
+  if (fd == STDOUT_FILENO)
     {
-      f->eax = -1;
-      __exit(-1);
+      putbuf (buffer, size);
+      return size;
     }
-    else if(*fd == 1)
+  file = get_plain_file (fd);
+  return file != NULL ? file_write (file, buffer, size) : -1;
+}
+
+/* Copies the IOVCNT iovecs at user address UIOV into IOV, which
+   must have room for IOV_MAX of them, and checks that each
+   segment lies in mapped user memory that is writable if WRITE is
+   true.  Returns false if IOVCNT is out of range or the segments
+   total more than INT_MAX bytes; kills the process if any address
+   is bad. */
+static bool
+copy_in_iov (struct iovec iov[], const struct iovec *uiov, int iovcnt,
+             bool write) 
+{
+  size_t total = 0;
+  int i;
+
+  if (iovcnt < 0 || iovcnt > IOV_MAX)
+    return false;
+  if (!copy_from_user (iov, uiov, iovcnt * sizeof *iov))
+    __exit(-1);
+  for (i = 0; i < iovcnt; i++)
     {
-      putbuf(*buffer, *size);
-      f->eax = *size;
+      if (iov[i].iov_len > INT_MAX - total)
+        return false;
+      total += iov[i].iov_len;
+      check_buffer (iov[i].iov_base, iov[i].iov_len, write);
     }
-    else if(*fd > 1)
+  return true;
+}
+
+/* readv (int fd, const struct iovec *iov, int iovcnt) */
+static uint32_t
+sys_readv (const uint32_t args[]) 
+{
+  struct iovec iov[IOV_MAX];
+  int fd = args[0];
+  int iovcnt = args[2];
+  struct file *file;
+
+  if (!copy_in_iov (iov, (const struct iovec *) args[1], iovcnt, true))
+    return -1;
+  if (fd == STDIN_FILENO)
     {
-      lock_acquire(&filesys_lock);
-      for(i=0;i<cur->fd_pos;i++)
-      {
-        if(cur->fd[i] == *fd)
+      int bytes_read = 0;
+      int i;
+      size_t j;
+
+      for (i = 0; i < iovcnt; i++)
         {
-          if(cur->fd_file[i] == NULL)
-            __exit(-1);
-          else
-            f->eax = file_write(cur->fd_file[i],*buffer,*size);
+          for (j = 0; j < iov[i].iov_len; j++)
+            ((uint8_t *) iov[i].iov_base)[j] = input_getc ();
+          bytes_read += iov[i].iov_len;
         }
-      }
-      lock_release(&filesys_lock);
-    }
-    break;
-  case SYS_REMOVE:                
-    if(bad_ptr(usp + 4, f)) break;
-    file = usp + 4;               
-    if(!check_filename_address(*file))     
-    {                             
-      f->eax = -1;                
-      __exit(-1);                   
-    }
-    lock_acquire(&filesys_lock);
-    f->eax = filesys_remove(*file);
-    lock_release(&filesys_lock);
-    break;                        
-  case SYS_EXEC:                          
-    if(bad_ptr(usp + 4, f)) break;        
-    file = usp + 4;                       
-    if(!check_filename_address(*file))             
-    {                                     
-      f->eax = -1;                        
-      __exit(-1);                           
-    }                                     
-    f->eax = process_execute(*file);      
-    tid_t ctid = thread_current ()->ctid; 
-    struct thread *ct = thread_wait(ctid);
-    if(ct == NULL){                       
-      f->eax = -1;                        
-      break;                              
-    }                                     
-    sema_down(&(ct->load_sema));          
-    if(!ct->load_status)                  
-    {                                     
-      f->eax = -1;                        
-    }                                     
-    break;                                
-  case SYS_READ:
-    if(bad_ptr(usp + 20, f)) break;
-    if(bad_ptr(usp + 24, f)) break;
-    if(bad_ptr(usp + 28, f)) break;
-
-    lock_acquire(&filesys_lock);
-    fd = usp + 20;
-    buffer = usp + 24;
-    size = usp + 28;
-    if(!check_address(*buffer))
-    {
-      f->eax = -1;
-      lock_release(&filesys_lock);
-      __exit(-1);
-    }
-    else if(*fd == 0)
-    {
-      for(i = 0; i < size; i++)
-      {
-        *(buffer++) = input_getc();
-      }
+      return bytes_read;
     }
-    else if(*fd > 1)
+  file = get_plain_file (fd);
+  return file != NULL ? file_readv (file, iov, iovcnt) : -1;
+}
+
+/* writev (int fd, const struct iovec *iov, int iovcnt) */
+static uint32_t
+sys_writev (const uint32_t args[]) 
+{
+  struct iovec iov[IOV_MAX];
+  int fd = args[0];
+  int iovcnt = args[2];
+  struct file *file;
+
+  if (!copy_in_iov (iov, (const struct iovec *) args[1], iovcnt, false))
+    return -1;
+  if (fd == STDOUT_FILENO)
     {
-      for(i=0;i<cur->fd_pos;i++)
-      {
-        if(cur->fd[i] == *fd)
+      int bytes_written = 0;
+      int i;
+
+      for (i = 0; i < iovcnt; i++)
         {
-          if(cur->fd_file[i] == NULL)
-          {
-            f->eax = -1;
-            lock_release(&filesys_lock);
-            __exit(-1);
-          }
-          else
-          {
-            f->eax = file_read(cur->fd_file[i],*buffer,*size);
-          }
+          putbuf (iov[i].iov_base, iov[i].iov_len);
+          bytes_written += iov[i].iov_len;
         }
-      }
+      return bytes_written;
     }
-    lock_release(&filesys_lock);
-    break;
-  case SYS_WAIT:                                                 
-    if(bad_ptr(usp + 4, f)) break;                               
-    tid_t child_tid = *(tid_t *)(usp + 4);                       
-    f->eax = process_wait(child_tid);                            
-    break;                                                       
-  case SYS_SEEK: // (int fd, unsigned position)                  
-    if(bad_ptr(usp + 16, f)) break;                              
-    if(bad_ptr(usp + 20, f)) break;                              
-                                                               
-    lock_acquire(&filesys_lock);
-    fd = usp + 16;                                               
-    position = usp + 20;                                         
-    for(i=0;i<cur->fd_pos;i++)                                   
-    {                                                            
-      if(cur->fd[i] == *fd)                                      
-      {                                                          
-        if(cur->fd_file[i] == NULL)                              
-        {                                                        
-          f->eax = -1;                                           
-          lock_release(&filesys_lock);
-          __exit(-1);                                              
-        }                                                        
-        else                                                     
-        {                                                        
-          //printf("Sucessfully match fd and file structure\n"); 
-          file_seek(cur->fd_file[i],*position);                  
-          //printf("wanted : %d, real : %d\n",f->eax,*size);     
-        }                                                        
-      }                                                          
-    }                                                            
-    lock_release(&filesys_lock);
-    break;
-  case SYS_SENDSIG:
-    if(bad_ptr(usp + 16, f)) break;                              
-    if(bad_ptr(usp + 20, f)) break;
-    child_tid = *(tid_t *)(usp + 16);                       
-    signum = usp + 20;
-    struct thread *t = thread_wait(child_tid);
-    if (is_user_vaddr(t->handler[*signum]))
-      printf("Signum: %d, Action: %p\n",*signum,t->handler[*signum]);
-    break;
-  case SYS_SIGACTION:
-    if(bad_ptr(usp + 16, f)) break;                              
-    if(bad_ptr(usp + 20, f)) break;
-    signum = usp + 16;    
-    handler = usp + 20;
-    thread_current()->handler[*signum] = *handler; 
-    // printf("Signum : %d, Action : %p\n", *signum, t->handler[*signum]);
-    break;
-  case SYS_YIELD:
-    thread_yield();
-    break;
-  }
-}
-
-static bool // Modified
-check_address(void * uva)
-{
-  if(!is_user_vaddr(uva))
-    return false;
-  uint32_t* pd;
+  file = get_plain_file (fd);
+  return file != NULL ? file_writev (file, iov, iovcnt) : -1;
+}
+
+/* seek (int fd, unsigned position) */
+static uint32_t
+sys_seek (const uint32_t args[]) 
+{
+  struct file *file = process_get_file (args[0]);
+
+  if (file != NULL)
+    file_seek (file, args[1]);
+  return 0;
+}
+
+/* tell (int fd) */
+static uint32_t
+sys_tell (const uint32_t args[]) 
+{
+  struct file *file = process_get_file (args[0]);
+
+  return file != NULL ? file_tell (file) : -1;
+}
+
+/* close (int fd) */
+static uint32_t
+sys_close (const uint32_t args[]) 
+{
+  file_close (process_remove_file (args[0]));
+  return 0;
+}
+
+/* sigaction (int signum, void (*handler) (void)) */
+static uint32_t
+sys_sigaction (const uint32_t args[]) 
+{
+  uint32_t signum = args[0];
+
+  if (signum < SIGNAL_CNT)
+    thread_current ()->handler[signum] = (void (*) (void)) args[1];
+  return 0;
+}
+
+/* A signal handler looked up with get_handler(). */
+struct handler_query 
+  {
+    uint32_t signum;            /* Signal number. */
+    void (*handler) (void);     /* Thread's handler for SIGNUM. */
+  };
+
+/* Copies thread T's handler for the signal in AUX, a struct
+   handler_query, into AUX. */
+static void
+get_handler (struct thread *t, void *aux) 
+{
+  struct handler_query *q = aux;
+  q->handler = t->handler[q->signum];
+}
+
+/* sendsig (pid_t pid, int signum) */
+static uint32_t
+sys_sendsig (const uint32_t args[]) 
+{
+  tid_t child_tid = args[0];
+  struct handler_query q;
+
+  /* The child may exit at any time, so its handler is copied out
+     while it cannot be freed. */
+  q.signum = args[1];
+  if (q.signum < SIGNAL_CNT && process_find_child (child_tid) != NULL
+      && thread_apply (child_tid, get_handler, &q)
+      && is_user_vaddr (q.handler))
+    printf ("Signum: %d, Action: %p\n", q.signum, q.handler);
+  return 0;
+}
+
+/* yield (void) */
+static uint32_t
+sys_yield (const uint32_t args[] UNUSED) 
+{
+  thread_yield ();
+  return 0;
+}
+
+/* chdir (const char *dir) */
+static uint32_t
+sys_chdir (const uint32_t args[]) 
+{
+  char *name = copy_in_string ((const char *) args[0]);
+  struct dir *dir = name != NULL ? filesys_open_dir (name) : NULL;
   struct thread *cur = thread_current ();
-  pd = cur->pagedir;
-  if(!pagedir_get_page(pd, uva))
+
+  palloc_free_page (name);
+  if (dir == NULL)
     return false;
+  dir_close (cur->cwd);
+  cur->cwd = dir;
   return true;
 }
 
-static bool
-check_filename_address(void * filename)
+/* mkdir (const char *dir) */
+static uint32_t
+sys_mkdir (const uint32_t args[]) 
 {
-  char *p;
-  for (p = filename;;p++)
-  {
-    if (!check_address(p))
-      return false;
-    else if (*p == '\0')
-      return true;
-  } 
+  char *name = copy_in_string ((const char *) args[0]);
+  bool success = name != NULL && filesys_mkdir (name);
+
+  palloc_free_page (name);
+  return success;
 }
 
-static uint32_t // May be changed to allocate empty integer after 1
-allocate_fd(void) // used to allocate file descriptor
+/* readdir (int fd, char name[READDIR_MAX_LEN + 1]) */
+static uint32_t
+sys_readdir (const uint32_t args[]) 
 {
-  static uint32_t file_descriptor_remain = 2; // 0, 1, and 2 might be occupied.
-  uint32_t _return_;
-  _return_ = file_descriptor_remain++;
-  return _return_;
+  struct file *file = process_get_file (args[0]);
+  char name[NAME_MAX + 1];
+  struct dir *dir;
+  bool success;
+
+  if (file == NULL || !inode_is_dir (file_get_inode (file)))
+    return false;
+
+  /* The file's position is the directory's read position. */
+  dir = dir_open (inode_reopen (file_get_inode (file)));
+  if (dir == NULL)
+    return false;
+  dir_seek (dir, file_tell (file));
+  success = dir_readdir (dir, name);
+  file_seek (file, dir_tell (dir));
+  dir_close (dir);
+
+  if (success && !copy_to_user ((void *) args[1], name, strlen (name) + 1))
+    __exit(-1);
+  return success;
 }
 
-int32_t __exit(int status)
+/* isdir (int fd) */
+static uint32_t
+sys_isdir (const uint32_t args[]) 
 {
-    printf("%s: exit(%d)\n",thread_name(), status);
-    struct thread *cur = thread_current ();
-    unsigned int i;
-    for(i = 0; i < cur->fd_pos; i++)
-    {
-      file_close(cur->fd_file[i]);
-    }
-    struct list_elem* e;
-    cur->exit_status = status;
-    /* Cleaning Up Child Process */
-    for (e = list_begin (&all_list); e != list_end (&all_list);
-       e = list_next (e))
-    {
-      struct thread *t = list_entry (e, struct thread, allelem);
-      if(t->ptid == cur->tid && !t->seen_status)
-        process_wait(t->tid);
-    }
-    lock_acquire(&filesys_lock);
-    file_allow_write(cur->itself);
-    lock_release(&filesys_lock);
-    thread_exit();
+  struct file *file = process_get_file (args[0]);
+
+  return file != NULL && inode_is_dir (file_get_inode (file));
 }
 
-static bool bad_ptr(void* ptr, struct intr_frame *f)
+/* inumber (int fd) */
+static uint32_t
+sys_inumber (const uint32_t args[]) 
 {
-  unsigned int i;
-  for (i = 0; i < 4; i++) 
-  {
-    if(!check_address(ptr + i))
+  struct file *file = process_get_file (args[0]);
+
+  return file != NULL ? (int) inode_get_inumber (file_get_inode (file)) : -1;
+}
+
+/* Copies the null-terminated string at user address USTR into a
+   new page, which the caller must free with palloc_free_page(),
+   and returns it.  A string longer than a page is truncated.
+   Returns a null pointer if no page is available, or kills the
+   process if USTR is a bad pointer. */
+static char *
+copy_in_string (const char *ustr)
+{
+  char *kstr = palloc_get_page (0);
+
+  if (kstr == NULL)
+    return NULL;
+  if (strncpy_from_user (kstr, ustr, PGSIZE) == -1)
     {
+      palloc_free_page (kstr);
       __exit(-1);
-      f->eax = -1;
-      return true;
     }
-  }
-  return false;
+  return kstr;
+}
+
+/* Returns the open file for FD, or a null pointer if FD is not
+   open or is a directory, which cannot be read or written as a
+   file. */
+static struct file *
+get_plain_file (int fd) 
+{
+  struct file *file = process_get_file (fd);
+
+  if (file != NULL && inode_is_dir (file_get_inode (file)))
+    return NULL;
+  return file;
+}
+
+/* Kills the process unless the SIZE bytes at user address UBUF
+   are all mapped, and writable if WRITE is true. */
+static void
+check_buffer (const void *ubuf, unsigned size, bool write)
+{
+  if (!check_user_range (ubuf, size, write))
+    __exit(-1);
 }
 
+int32_t __exit(int status)
+{
+    printf("%s: exit(%d)\n",thread_name(), status);
+    struct thread *cur = thread_current ();
+    int fd;
+    for(fd = 0; fd < cur->file_slots; fd++)
+      file_close(process_remove_file(fd));
+    if (cur->record != NULL)
+      cur->record->exit_status = status;
+    file_allow_write(cur->itself);
+    thread_exit();
+}
@@ -3,6 +3,7 @@
 #include <stdint.h>
 
 void syscall_init (void);
+void syscall_print_stats (void);
 
 int32_t __exit(int status);
 
@@ -0,0 +1,216 @@
+#include "userprog/uaccess.h"
+#include <debug.h>
+#include <stdint.h>
+#include "threads/interrupt.h"
+#include "threads/vaddr.h"
+
+/* Access to user memory.
+
+   Rather than walking the page directory to check every user
+   address before touching it, the routines in this file simply
+   touch it.  Each access is a single instruction preceded by one
+   that loads the address of the instruction following it into
+   %eax.  If the access faults, page_fault() calls
+   uaccess_fixup(), which resumes execution at that address with
+   %eax set to -1, so the routine sees the failure and returns.
+
+   Only faults on instructions between _start_uaccess and
+   _end_uaccess are treated this way; the linker script collects
+   every function placed in the .text.uaccess section there.  A
+   fault elsewhere in the kernel is still a kernel bug.
+
+   Kernel addresses do not fault in kernel mode, so each routine
+   checks that its whole range lies below PHYS_BASE first. */
+
+/* Places a function among those whose faults are fixed up. */
+#define UACCESS __attribute__ ((section (".text.uaccess"), noinline))
+
+/* The single-access helpers must be inlined into such functions. */
+#define ACCESSOR static inline __attribute__ ((always_inline))
+
+/* Bounds of the .text.uaccess section, from the linker script. */
+extern char _start_uaccess[], _end_uaccess[];
+
+/* Returns the byte at user virtual address UADDR, or -1 if the
+   access faulted.  UADDR must be below PHYS_BASE. */
+ACCESSOR int
+get_user (const uint8_t *uaddr)
+{
+  int result;
+  asm ("movl $1f, %0; movzbl %1, %0; 1:"
+       : "=&a" (result) : "m" (*uaddr));
+  return result;
+}
+
+/* Stores the word at user virtual address UADDR into *DST.
+   Returns true if successful, false if the access faulted.
+   UADDR must be below PHYS_BASE. */
+ACCESSOR bool
+get_user_word (uint32_t *dst, const uint32_t *uaddr)
+{
+  int error;
+  uint32_t value;
+  asm ("movl $1f, %0; movl %2, %1; xorl %0, %0; 1:"
+       : "=&a" (error), "=&r" (value) : "m" (*uaddr) : "cc");
+  if (error != 0)
+    return false;
+  *dst = value;
+  return true;
+}
+
+/* Writes BYTE to user address UDST.  Returns true if successful,
+   false if the access faulted.  UDST must be below PHYS_BASE. */
+ACCESSOR bool
+put_user (uint8_t *udst, uint8_t byte)
+{
+  int error;
+  asm ("movl $1f, %0; movb %b2, %1; xorl %0, %0; 1:"
+       : "=&a" (error), "=m" (*udst) : "q" (byte) : "cc");
+  return error == 0;
+}
+
+/* Writes WORD to user address UDST.  Returns true if successful,
+   false if the access faulted.  UDST must be below PHYS_BASE. */
+ACCESSOR bool
+put_user_word (uint32_t *udst, uint32_t word)
+{
+  int error;
+  asm ("movl $1f, %0; movl %2, %1; xorl %0, %0; 1:"
+       : "=&a" (error), "=m" (*udst) : "r" (word) : "cc");
+  return error == 0;
+}
+
+/* Returns true if the SIZE bytes starting at UADDR all lie below
+   PHYS_BASE. */
+static inline bool
+is_user_range (const void *uaddr, size_t size)
+{
+  return (uintptr_t) uaddr <= (uintptr_t) PHYS_BASE
+         && size <= (uintptr_t) PHYS_BASE - (uintptr_t) uaddr;
+}
+
+/* Copies SIZE bytes from user address USRC to kernel address
+   DST.  Returns true if successful, false if any byte of the
+   source is not mapped or not in user memory. */
+UACCESS bool
+copy_from_user (void *dst_, const void *usrc_, size_t size)
+{
+  uint8_t *dst = dst_;
+  const uint8_t *usrc = usrc_;
+
+  if (!is_user_range (usrc, size))
+    return false;
+
+  for (; size >= sizeof (uint32_t); size -= sizeof (uint32_t))
+    {
+      if (!get_user_word ((uint32_t *) dst, (const uint32_t *) usrc))
+        return false;
+      dst += sizeof (uint32_t);
+      usrc += sizeof (uint32_t);
+    }
+  for (; size > 0; size--)
+    {
+      int byte = get_user (usrc++);
+      if (byte == -1)
+        return false;
+      *dst++ = byte;
+    }
+  return true;
+}
+
+/* Copies SIZE bytes from kernel address SRC to user address
+   UDST.  Returns true if successful, false if any byte of the
+   destination is not mapped, is read-only, or is not in user
+   memory. */
+UACCESS bool
+copy_to_user (void *udst_, const void *src_, size_t size)
+{
+  uint8_t *udst = udst_;
+  const uint8_t *src = src_;
+
+  if (!is_user_range (udst, size))
+    return false;
+
+  for (; size >= sizeof (uint32_t); size -= sizeof (uint32_t))
+    {
+      if (!put_user_word ((uint32_t *) udst, *(const uint32_t *) src))
+        return false;
+      udst += sizeof (uint32_t);
+      src += sizeof (uint32_t);
+    }
+  for (; size > 0; size--)
+    if (!put_user (udst++, *src++))
+      return false;
+  return true;
+}
+
+/* Copies the null-terminated string at user address USRC into
+   the SIZE-byte buffer DST.  Returns the length of the string, not
+   counting the null terminator, or -1 if the string runs into
+   memory that is not mapped or not in user memory.  If the
+   string does not fit, copies SIZE - 1 bytes, null-terminates
+   DST, and returns SIZE. */
+UACCESS int
+strncpy_from_user (char *dst, const char *usrc, size_t size)
+{
+  size_t i;
+
+  ASSERT (size > 0);
+
+  for (i = 0; i < size - 1; i++)
+    {
+      int byte;
+
+      if ((uintptr_t) (usrc + i) >= (uintptr_t) PHYS_BASE)
+        return -1;
+      byte = get_user ((const uint8_t *) usrc + i);
+      if (byte == -1)
+        return -1;
+      dst[i] = byte;
+      if (byte == '\0')
+        return i;
+    }
+  dst[i] = '\0';
+  return size;
+}
+
+/* Returns true if the SIZE bytes starting at user address UADDR
+   are all mapped in user memory, and writable too if WRITE is
+   true, false otherwise.  Touches one byte per page, so the cost
+   does not grow with SIZE the way a byte-by-byte check does; a
+   write check writes back the byte it read. */
+UACCESS bool
+check_user_range (const void *uaddr, size_t size, bool write)
+{
+  const uint8_t *p = uaddr;
+  const uint8_t *end = p + size;
+
+  if (!is_user_range (uaddr, size))
+    return false;
+
+  while (p < end)
+    {
+      int byte = get_user (p);
+      if (byte == -1 || (write && !put_user ((uint8_t *) p, byte)))
+        return false;
+      p = pg_round_down (p) + PGSIZE;
+    }
+  return true;
+}
+
+/* Called by the page fault handler for a fault in kernel mode
+   described by F.  If the faulting instruction is one of the user
+   memory accesses above, arranges for it to fail and returns
+   true.  Otherwise, returns false. */
+bool
+uaccess_fixup (struct intr_frame *f)
+{
+  uint8_t *eip = (uint8_t *) f->eip;
+
+  if (eip < (uint8_t *) _start_uaccess || eip >= (uint8_t *) _end_uaccess)
+    return false;
+
+  f->eip = (void (*) (void)) f->eax;
+  f->eax = 0xffffffff;
+  return true;
+}